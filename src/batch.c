@@ -0,0 +1,258 @@
+/*
+ *  batch.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+
+#include "batch.h"
+
+/* A name is written as is in the records, so it is kept to characters that
+ * no format has to quote. */
+static gboolean batch_name_is_valid(const gchar *name)
+{
+  const gchar *c;
+
+  if (*name == '\0' || strlen(name) > BATCH_NAME_MAX)
+    return FALSE;
+
+  for (c = name; *c; c++)
+    if (!g_ascii_isalnum(*c) && *c != '-' && *c != '_' && *c != '.' && *c != ':')
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Called from the timing wheel when a job expires: writes its record. */
+static void batch_job_expired(ut_timer_table *table, ut_timer_handle handle, gpointer data)
+{
+  ut_batch *b = data;
+  guint index = GPOINTER_TO_UINT(timer_table_get_data(table, handle));
+  stream_completion completion;
+  gchar buf[STREAM_RECORD_MAX];
+  gsize len;
+
+  completion.name = g_ptr_array_index(b->names, index);
+  completion.mode = (g_array_index(b->modes, timer_mode, index) == TIMER_MODE_COUNTDOWN ? "countdown" : "timer");
+  completion.requested_ns = g_array_index(b->lengths, ut_duration, index);
+  completion.actual_ns = ut_clock_source_now(b->clock) - b->start;
+  completion.lateness_ns = completion.actual_ns - completion.requested_ns;
+
+  if (b->format != STREAM_FORMAT_NONE)
+  {
+    len = stream_format_completion(buf, sizeof(buf), b->format, &completion);
+    if (!stream_write(b->fd, buf, len))
+      g_debug("%s: cannot write the record of %s", __FUNCTION__, completion.name);
+  }
+
+  if (++b->done == b->jobs->len)
+  {
+    g_debug("%s: all the %u timers expired", __FUNCTION__, b->done);
+    if (b->done_callback)
+      b->done_callback(b, b->user_data);
+  }
+}
+
+/**
+ * Creates a new, empty, batch of timers.
+ * @param context where the timers run
+ * @param clock the clock source the timers are measured on
+ * @param format how the records are written (STREAM_FORMAT_NONE: not at all)
+ * @param fd where the records are written
+ * @param done_callback called once every timer expired
+ * @param user_data given to done_callback
+ */
+ut_batch* batch_new(ut_context *context, ut_clock_source *clock, stream_format format, gint fd,
+                    batch_func done_callback, gpointer user_data)
+{
+  ut_batch *b = g_new0(ut_batch, 1);
+
+  g_assert(context && clock);
+
+  b->context = context;
+  b->clock = clock;
+  b->wheel = wheel_ref_for_clock(context, clock);
+  b->jobs = g_array_new(FALSE, FALSE, sizeof(ut_timer_handle));
+  b->names = g_ptr_array_new();
+  b->modes = g_array_new(FALSE, FALSE, sizeof(timer_mode));
+  b->lengths = g_array_new(FALSE, FALSE, sizeof(ut_duration));
+  b->format = format;
+  b->fd = fd;
+  b->done_callback = done_callback;
+  b->user_data = user_data;
+  return b;
+}
+
+void batch_free(ut_batch *b)
+{
+  guint i;
+
+  if (!b)
+    return;
+
+  for (i = 0; i < b->jobs->len; i++)
+    wheel_remove_timer(b->wheel, g_array_index(b->jobs, ut_timer_handle, i));
+  wheel_unref(b->wheel);
+
+  g_array_free(b->jobs, TRUE);
+  g_ptr_array_foreach(b->names, (GFunc) g_free, NULL);
+  g_ptr_array_free(b->names, TRUE);
+  g_array_free(b->modes, TRUE);
+  g_array_free(b->lengths, TRUE);
+  g_free(b);
+}
+
+/**
+ * Adds the timer described by a line of a batch file: NAME MODE TIMELENGTH,
+ * separated by blanks, where MODE is 'countdown' or 'timer' and TIMELENGTH
+ * is read by ut_parse_time_pattern() (e.g. "build-42 countdown 30m"). The
+ * jobs are all added before batch_start().
+ * @return FALSE if the line cannot be read
+ */
+gboolean batch_add_line(ut_batch *b, gchar *line)
+{
+  gchar **fields, *field[3];
+  ut_timer_handle handle;
+  timer_mode mode;
+  ut_duration length;
+  guint i, n = 0;
+
+  g_assert(!b->started); // the jobs all start together
+
+  fields = g_strsplit_set(g_strstrip(line), " \t", -1);
+  for (i = 0; fields[i]; i++)
+  {
+    if (*fields[i] == '\0')
+      continue;
+    if (n == G_N_ELEMENTS(field))
+    {
+      n++;
+      break;
+    }
+    field[n++] = fields[i];
+  }
+
+  if (n != G_N_ELEMENTS(field) || !batch_name_is_valid(field[0]))
+  {
+    g_strfreev(fields);
+    return FALSE;
+  }
+
+  if (g_ascii_strcasecmp(field[1], "countdown") == 0)
+    mode = TIMER_MODE_COUNTDOWN;
+  else if (g_ascii_strcasecmp(field[1], "timer") == 0)
+    mode = TIMER_MODE_TIMER;
+  else
+  {
+    g_strfreev(fields);
+    return FALSE;
+  }
+
+  if (!ut_parse_time_pattern(field[2], &length))
+  {
+    g_strfreev(fields);
+    return FALSE;
+  }
+
+  // disarmed until batch_start()
+  handle = wheel_add_timer(b->wheel, batch_job_expired, b, GUINT_TO_POINTER(b->jobs->len));
+  if (handle == TIMER_HANDLE_NONE)
+  {
+    g_strfreev(fields);
+    return FALSE;
+  }
+
+  g_array_append_val(b->jobs, handle);
+  g_ptr_array_add(b->names, g_strdup(field[0]));
+  g_array_append_val(b->modes, mode);
+  g_array_append_val(b->lengths, length);
+
+  g_strfreev(fields);
+  return TRUE;
+}
+
+/**
+ * Reads every timer of a batch file (see batch_add_line()). Empty lines and
+ * lines starting with '#' are skipped. Errors are printed with the line
+ * number.
+ * @param filename the name of in, for the errors
+ * @return FALSE if a line cannot be read
+ */
+gboolean batch_read(ut_batch *b, FILE *in, const gchar *filename)
+{
+  gchar *line = NULL;
+  gsize size = 0;
+  guint number = 0;
+  gboolean ok = TRUE;
+
+  while (getline(&line, &size, in) >= 0)
+  {
+    gchar *start = line;
+
+    number++;
+    while (g_ascii_isspace(*start))
+      start++;
+    if (*start == '\0' || *start == '#')
+      continue;
+
+    if (!batch_add_line(b, start))
+    {
+      g_printerr(_("%s:%u: cannot read this timer (expected NAME countdown|timer TIMELENGTH).\n"),
+                 filename, number);
+      ok = FALSE;
+    }
+  }
+
+  free(line);
+  return ok;
+}
+
+/**
+ * Starts every timer of the batch now. The CSV and TSV header is written
+ * first, then a record each time a timer expires.
+ */
+void batch_start(ut_batch *b)
+{
+  gchar buf[STREAM_RECORD_MAX];
+  gsize len;
+  guint i;
+
+  g_assert(b && !b->started);
+
+  len = stream_format_completion_header(buf, sizeof(buf), b->format);
+  if (len > 0)
+    stream_write(b->fd, buf, len);
+
+  b->started = TRUE;
+  b->start = ut_clock_source_now(b->clock);
+  for (i = 0; i < b->jobs->len; i++)
+    wheel_arm(b->wheel, g_array_index(b->jobs, ut_timer_handle, i),
+              duration_add(b->start, g_array_index(b->lengths, ut_duration, i)));
+}
@@ -0,0 +1,71 @@
+/*
+ *  batch.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BATCH_H
+  #define BATCH_H
+
+  #include <stdio.h>
+  #include <glib.h>
+  #include "timer.h"
+  #include "wheel.h"
+  #include "stream.h"
+
+  #define BATCH_NAME_MAX 64 // keeps a completion record within STREAM_RECORD_MAX
+
+typedef struct _ut_batch ut_batch;
+
+/* Called from the main loop, with the user_data given to the batch. */
+typedef void (*batch_func)(ut_batch *b, gpointer user_data);
+
+/* The timers of --batch, called jobs. A job only needs a deadline: it is
+ * never displayed, paused or read before it expires, so it is only a timer
+ * of the timing wheel of the clock source in its context, rather than a
+ * whole ut_timer. Each job keeps its number as data, which indexes the
+ * arrays below. They all start together, and each one costs O(1) whatever
+ * their number, while a single deadline source waits for all of them. */
+struct _ut_batch
+{
+  ut_context *context;
+  ut_clock_source *clock;
+  ut_wheel *wheel; // whose table holds the jobs
+  GArray *jobs; // ut_timer_handle
+  GPtrArray *names;
+  GArray *modes; // timer_mode: TIMER_MODE_COUNTDOWN or TIMER_MODE_TIMER
+  GArray *lengths; // ut_duration
+  gboolean started;
+  guint done; // jobs that expired
+  gint64 start;
+  stream_format format;
+  gint fd;
+  batch_func done_callback;
+  gpointer user_data; // given to done_callback
+};
+
+ut_batch* batch_new(ut_context *context, ut_clock_source *clock, stream_format format, gint fd,
+                    batch_func done_callback, gpointer user_data);
+void batch_free(ut_batch *b);
+gboolean batch_add_line(ut_batch *b, gchar *line);
+gboolean batch_read(ut_batch *b, FILE *in, const gchar *filename);
+void batch_start(ut_batch *b);
+
+#endif /* BATCH_H */
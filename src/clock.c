@@ -0,0 +1,454 @@
+/*
+ *  clock.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <time.h>
+#include <glib.h>
+
+#if defined(HAVE_CPUID_H) && (defined(__i386__) || defined(__x86_64__))
+  #include <cpuid.h>
+  #define UT_CLOCK_HAVE_TSC 1
+#endif
+
+#include "clock.h"
+
+#define UT_CLOCK_TSC_CALIBRATION_MSEC 20
+
+static const gchar *ut_clock_source_names[] = {
+  "monotonic", "monotonic_raw", "boottime", "tsc", "virtual", "realtime"
+};
+
+static inline gint64 ut_clock_gettime(clockid_t id)
+{
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+  return (gint64) ts.tv_sec * UT_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+gint64 ut_clock_now()
+{
+  return ut_clock_gettime(CLOCK_MONOTONIC);
+}
+
+#ifdef UT_CLOCK_HAVE_TSC
+/* rdtscp waits for the previous instructions to be done, so the read is
+ * not moved earlier by the CPU. lfence does the same before rdtsc. */
+static inline guint64 ut_clock_tsc_read(const ut_clock_source *s)
+{
+  guint32 lo, hi, aux;
+
+  if (G_LIKELY(s->tsc_rdtscp))
+    __asm__ __volatile__ ("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+  else
+    __asm__ __volatile__ ("lfence\n\trdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+
+  return ((guint64) hi << 32) | lo;
+}
+
+/* Measures the TSC rate against CLOCK_MONOTONIC. This is only done when
+ * the TSC is invariant (it ticks at a constant rate whatever the frequency
+ * or sleep state of the CPU), otherwise it cannot be used as a clock. */
+static gboolean ut_clock_tsc_calibrate(ut_clock_source *s)
+{
+  guint eax, ebx, ecx, edx;
+  guint64 c0, c1;
+  gint64 t0, t1;
+
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+  {
+    g_debug("%s: the TSC is not invariant", __FUNCTION__);
+    return FALSE;
+  }
+
+  s->tsc_rdtscp = __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1 << 27));
+
+  // same order on both ends, so that the time between the reads cancels out
+  c0 = ut_clock_tsc_read(s);
+  t0 = ut_clock_now();
+  g_usleep(UT_CLOCK_TSC_CALIBRATION_MSEC * 1000);
+  c1 = ut_clock_tsc_read(s);
+  t1 = ut_clock_now();
+
+  if (c1 <= c0 || t1 <= t0)
+    return FALSE;
+
+  s->tsc_ns_per_tick = (gdouble) (t1 - t0) / (gdouble) (c1 - c0);
+  s->tsc_base = c1;
+  s->tsc_base_ns = t1;
+  g_debug("%s: %.3f MHz, rdtscp: %d", __FUNCTION__,
+          1000 / s->tsc_ns_per_tick, s->tsc_rdtscp ? 1 : 0);
+  return TRUE;
+}
+#endif
+
+static ut_clock_source ut_clock_source_monotonic = { UT_CLOCK_SOURCE_MONOTONIC, 0, NULL };
+static ut_clock_source ut_clock_source_realtime = { UT_CLOCK_SOURCE_REALTIME, 0, NULL };
+
+/**
+ * Returns the clock source reading CLOCK_MONOTONIC (see ut_clock_now()).
+ * It is shared and must not be freed.
+ */
+ut_clock_source* ut_clock_source_get_default()
+{
+  return &ut_clock_source_monotonic;
+}
+
+/**
+ * Returns the clock source reading CLOCK_REALTIME (the wall clock).
+ * It is shared and must not be freed.
+ */
+ut_clock_source* ut_clock_source_get_realtime()
+{
+  return &ut_clock_source_realtime;
+}
+
+/**
+ * Creates a new clock source of the given type.
+ * When the type is not available on this machine (e.g. the TSC is not
+ * invariant, or the kernel does not know the clock), the new source reads
+ * CLOCK_MONOTONIC instead: check its type to know. A TSC source is
+ * calibrated here, which takes a few milliseconds.
+ * Free it with ut_clock_source_free(), once no deadline source uses it.
+ */
+ut_clock_source* ut_clock_source_new(ut_clock_source_type type)
+{
+  ut_clock_source *s = g_new0(ut_clock_source, 1);
+  struct timespec ts;
+  gboolean available = FALSE;
+
+  s->type = type;
+
+  switch (type)
+  {
+    case UT_CLOCK_SOURCE_MONOTONIC:
+    case UT_CLOCK_SOURCE_VIRTUAL:
+    case UT_CLOCK_SOURCE_REALTIME:
+      available = TRUE;
+      break;
+    case UT_CLOCK_SOURCE_MONOTONIC_RAW:
+#ifdef CLOCK_MONOTONIC_RAW
+      available = (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == 0);
+#endif
+      break;
+    case UT_CLOCK_SOURCE_BOOTTIME:
+#ifdef CLOCK_BOOTTIME
+      available = (clock_gettime(CLOCK_BOOTTIME, &ts) == 0);
+#endif
+      break;
+    case UT_CLOCK_SOURCE_TSC:
+#ifdef UT_CLOCK_HAVE_TSC
+      available = ut_clock_tsc_calibrate(s);
+#endif
+      break;
+  }
+
+  if (!available)
+  {
+    g_debug("%s: the %s clock is not available, falling back to %s", __FUNCTION__,
+            ut_clock_source_type_to_string(type),
+            ut_clock_source_type_to_string(UT_CLOCK_SOURCE_MONOTONIC));
+    s->type = UT_CLOCK_SOURCE_MONOTONIC;
+  }
+
+  return s;
+}
+
+/**
+ * Creates a new virtual clock source, starting at time 0.
+ */
+ut_clock_source* ut_clock_source_new_virtual()
+{
+  return ut_clock_source_new(UT_CLOCK_SOURCE_VIRTUAL);
+}
+
+/**
+ * Reads the type of clock source called name (e.g. "monotonic" or "tsc").
+ * @return FALSE if name is unknown
+ */
+gboolean ut_clock_source_type_from_string(const gchar *name, ut_clock_source_type *type)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(ut_clock_source_names); i++)
+  {
+    if (g_ascii_strcasecmp(name, ut_clock_source_names[i]) == 0)
+    {
+      *type = (ut_clock_source_type) i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+const gchar* ut_clock_source_type_to_string(ut_clock_source_type type)
+{
+  g_assert((guint) type < G_N_ELEMENTS(ut_clock_source_names));
+  return ut_clock_source_names[type];
+}
+
+void ut_clock_source_free(ut_clock_source *s)
+{
+  g_assert(s && s != &ut_clock_source_monotonic && s != &ut_clock_source_realtime
+           && !s->deadlines);
+  g_free(s);
+}
+
+/**
+ * Returns the current time of the given clock source, in nanoseconds.
+ */
+gint64 ut_clock_source_now(const ut_clock_source *s)
+{
+  switch (s->type)
+  {
+#ifdef UT_CLOCK_HAVE_TSC
+    case UT_CLOCK_SOURCE_TSC:
+      return s->tsc_base_ns + (gint64) ((gdouble) (gint64) (ut_clock_tsc_read(s) - s->tsc_base)
+                                        * s->tsc_ns_per_tick);
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+    case UT_CLOCK_SOURCE_MONOTONIC_RAW:
+      return ut_clock_gettime(CLOCK_MONOTONIC_RAW);
+#endif
+#ifdef CLOCK_BOOTTIME
+    case UT_CLOCK_SOURCE_BOOTTIME:
+      return ut_clock_gettime(CLOCK_BOOTTIME);
+#endif
+    case UT_CLOCK_SOURCE_VIRTUAL:
+      return s->now;
+    case UT_CLOCK_SOURCE_REALTIME:
+      return ut_clock_gettime(CLOCK_REALTIME);
+    default:
+      return ut_clock_now();
+  }
+}
+
+/**
+ * Moves a virtual clock source forward by d (instead of waiting d).
+ */
+void ut_clock_source_advance(ut_clock_source *s, ut_duration d)
+{
+  g_assert(s && s->type == UT_CLOCK_SOURCE_VIRTUAL && d >= 0);
+
+  s->now += d;
+}
+
+/* Tells the CPU we are busy-waiting (saves power, and the sibling
+ * hyperthread gets the execution units). */
+static inline void ut_clock_cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__ ("pause");
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__ ("yield");
+#endif
+}
+
+/* Seqlock of a ut_clock. A writer makes seq odd with a compare-and-swap,
+ * so that two writers never interleave, and even again when done. A reader
+ * copies the state (and reads the clock source) between two reads of seq,
+ * and starts again if a writer was there in between. The GLib atomic
+ * operations are full barriers, so the copies stay between them. */
+static void ut_clock_write_begin(ut_clock *c)
+{
+  gint seq;
+
+  for (;;)
+  {
+    seq = g_atomic_int_get(&c->seq);
+    if (!(seq & 1) && g_atomic_int_compare_and_exchange(&c->seq, seq, seq + 1))
+      return;
+    ut_clock_cpu_relax();
+  }
+}
+
+static inline void ut_clock_write_end(ut_clock *c)
+{
+  g_atomic_int_inc(&c->seq);
+}
+
+static inline gint ut_clock_read_begin(const ut_clock *c)
+{
+  gint seq;
+
+  while ((seq = g_atomic_int_get((volatile gint *) &c->seq)) & 1)
+    ut_clock_cpu_relax();
+
+  return seq;
+}
+
+static inline gboolean ut_clock_read_retry(const ut_clock *c, gint seq)
+{
+  return g_atomic_int_get((volatile gint *) &c->seq) != seq;
+}
+
+/**
+ * Creates a new clock reading CLOCK_MONOTONIC, already started (like
+ * g_timer_new()).
+ */
+ut_clock* ut_clock_new()
+{
+  return ut_clock_new_with_source(ut_clock_source_get_default());
+}
+
+/**
+ * Creates a new clock reading the given clock source, already started.
+ */
+ut_clock* ut_clock_new_with_source(ut_clock_source *s)
+{
+  ut_clock *c = g_new(ut_clock, 1);
+
+  g_assert(s);
+
+  c->source = s;
+  c->seq = 0;
+  ut_clock_start(c);
+  return c;
+}
+
+void ut_clock_destroy(ut_clock *c)
+{
+  g_free(c);
+}
+
+/**
+ * Resets the clock to 0 and starts it.
+ */
+void ut_clock_start(ut_clock *c)
+{
+  g_assert(c);
+
+  ut_clock_write_begin(c);
+  c->elapsed = 0;
+  c->active = TRUE;
+  c->start = ut_clock_source_now(c->source);
+  ut_clock_write_end(c);
+}
+
+/**
+ * Stops the clock, the elapsed time does not increase until
+ * ut_clock_continue() is called.
+ */
+void ut_clock_stop(ut_clock *c)
+{
+  g_assert(c);
+
+  ut_clock_write_begin(c);
+  if (c->active)
+  {
+    c->elapsed += ut_clock_source_now(c->source) - c->start;
+    c->active = FALSE;
+  }
+  ut_clock_write_end(c);
+}
+
+/**
+ * Continues a clock stopped by ut_clock_stop().
+ */
+void ut_clock_continue(ut_clock *c)
+{
+  g_assert(c);
+
+  ut_clock_write_begin(c);
+  if (!c->active)
+  {
+    c->start = ut_clock_source_now(c->source);
+    c->active = TRUE;
+  }
+  ut_clock_write_end(c);
+}
+
+/**
+ * Returns the time elapsed on the clock, not counting the time it was
+ * stopped. It may be called from any thread.
+ */
+ut_duration ut_clock_elapsed(const ut_clock *c)
+{
+  ut_duration elapsed;
+  gint seq;
+
+  g_assert(c);
+
+  do
+  {
+    seq = ut_clock_read_begin(c);
+    elapsed = c->elapsed;
+    if (c->active)
+      elapsed += ut_clock_source_now(c->source) - c->start;
+  } while (ut_clock_read_retry(c, seq));
+
+  return elapsed;
+}
+
+/**
+ * Returns FALSE while the clock is stopped. It may be called from any
+ * thread.
+ */
+gboolean ut_clock_is_active(const ut_clock *c)
+{
+  gboolean active;
+  gint seq;
+
+  g_assert(c);
+
+  do
+  {
+    seq = ut_clock_read_begin(c);
+    active = c->active;
+  } while (ut_clock_read_retry(c, seq));
+
+  return active;
+}
+
+/**
+ * Busy-waits until the elapsed time of the clock reaches target.
+ * This burns a CPU: only use it for very short waits. A virtual clock
+ * source is advanced to target instead.
+ * Returns the elapsed time when done (target, plus a few nanoseconds).
+ */
+ut_duration ut_clock_spin_until(const ut_clock *c, ut_duration target)
+{
+  ut_duration elapsed;
+
+  g_assert(c && ut_clock_is_active(c));
+
+  if (c->source->type == UT_CLOCK_SOURCE_VIRTUAL)
+  {
+    elapsed = ut_clock_elapsed(c);
+    if (elapsed < target)
+      ut_clock_source_advance(c->source, target - elapsed);
+    return ut_clock_elapsed(c);
+  }
+
+  while ((elapsed = ut_clock_elapsed(c)) < target)
+    ut_clock_cpu_relax();
+
+  return elapsed;
+}
@@ -0,0 +1,91 @@
+/*
+ *  clock.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLOCK_H
+  #define CLOCK_H
+
+  #include <glib.h>
+  #include "libutimer.h"
+
+typedef enum
+{
+  UT_CLOCK_SOURCE_MONOTONIC,
+  UT_CLOCK_SOURCE_MONOTONIC_RAW,
+  UT_CLOCK_SOURCE_BOOTTIME,
+  UT_CLOCK_SOURCE_TSC,
+  UT_CLOCK_SOURCE_VIRTUAL,
+  UT_CLOCK_SOURCE_REALTIME
+} ut_clock_source_type;
+
+/* Where a ut_clock (and the deadline sources waiting on it) read the time.
+ * The kernel clocks are read with clock_gettime(). The TSC source reads the
+ * CPU time stamp counter, scaled to nanoseconds by a calibration against
+ * CLOCK_MONOTONIC, and starts at the CLOCK_MONOTONIC time of that
+ * calibration. The realtime source is the wall clock (CLOCK_REALTIME), it
+ * jumps when the clock is set: it is only used for deadlines given as a
+ * time of day (see timer_set_until()). A virtual source does not follow real time: it only moves
+ * forward when advanced, or when the main loop would otherwise sleep until
+ * a deadline (see deadline.c). The test suite uses it to run timers
+ * instantly. */
+typedef struct
+{
+  ut_clock_source_type type;
+  gint64 now; // current time of a virtual source, in nanoseconds
+  GSList *deadlines; // deadline sources waiting on a virtual source
+  guint64 tsc_base; // TSC value at calibration
+  gint64 tsc_base_ns; // CLOCK_MONOTONIC time at calibration
+  gdouble tsc_ns_per_tick;
+  gboolean tsc_rdtscp; // rdtscp is available
+} ut_clock_source;
+
+/* A pausable stopwatch with nanosecond resolution, used instead of GTimer
+ * (which only gives microseconds). Its state is behind a seqlock: any
+ * thread reads a consistent elapsed time without locking, while stopping
+ * and continuing it (from any thread too) only wait for each other. */
+struct _ut_clock
+{
+  ut_clock_source *source;
+  volatile gint seq; // odd while the state below is being written
+  volatile gint64 start; // when the clock was last (re)started or continued
+  volatile ut_duration elapsed; // time accumulated before that
+  volatile gboolean active;
+};
+
+gint64 ut_clock_now();
+ut_clock_source* ut_clock_source_get_default();
+ut_clock_source* ut_clock_source_get_realtime();
+ut_clock_source* ut_clock_source_new(ut_clock_source_type type);
+ut_clock_source* ut_clock_source_new_virtual();
+gboolean ut_clock_source_type_from_string(const gchar *name, ut_clock_source_type *type);
+const gchar* ut_clock_source_type_to_string(ut_clock_source_type type);
+void ut_clock_source_free(ut_clock_source *s);
+gint64 ut_clock_source_now(const ut_clock_source *s);
+void ut_clock_source_advance(ut_clock_source *s, ut_duration d);
+ut_clock* ut_clock_new_with_source(ut_clock_source *s);
+void ut_clock_stop(ut_clock *c);
+void ut_clock_continue(ut_clock *c);
+ut_duration ut_clock_elapsed(const ut_clock *c);
+gboolean ut_clock_is_active(const ut_clock *c);
+ut_duration ut_clock_spin_until(const ut_clock *c, ut_duration target);
+
+#endif /* CLOCK_H */
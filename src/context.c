@@ -0,0 +1,114 @@
+/*
+ *  context.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "context.h"
+#include "utils.h"
+
+/**
+ * Creates a new context, for timers running on the given main context.
+ * @param main_context where the timers attach their sources, NULL for the
+ * default main context (it is referenced until ut_context_free())
+ */
+ut_context* ut_context_new(GMainContext *main_context)
+{
+  ut_context *ctx = g_new0(ut_context, 1);
+
+  ctx->main_context = g_main_context_ref(main_context ? main_context : g_main_context_default());
+  return ctx;
+}
+
+/**
+ * Frees the given context, once the timers and batches using it are
+ * destroyed.
+ */
+void ut_context_free(ut_context *ctx)
+{
+  if (!ctx)
+    return;
+
+  g_assert(!ctx->wheels);
+  g_main_context_unref(ctx->main_context);
+  g_free(ctx);
+}
+
+GMainContext* ut_context_get_main_context(const ut_context *ctx)
+{
+  g_assert(ctx);
+  return ctx->main_context;
+}
+
+/**
+ * Stops (or starts again) printing the timers of the given context.
+ */
+void ut_context_set_quiet(ut_context *ctx, gboolean quiet)
+{
+  g_assert(ctx);
+  ctx->quiet = quiet;
+}
+
+/**
+ * Asks for the next printed frame to be drawn in full, e.g. when the
+ * terminal was resized or something else was written on the line.
+ */
+void ut_context_redraw(ut_context *ctx)
+{
+  g_assert(ctx);
+  ctx->redraw = TRUE;
+}
+
+/**
+ * Tells the given context that the terminal was resized: the next printed
+ * frame measures the terminal again and is drawn in full. Only flags are
+ * set, so this is cheap enough to be called for every SIGWINCH (from the
+ * main loop, not from a signal handler).
+ */
+void ut_context_resized(ut_context *ctx)
+{
+  g_assert(ctx);
+  ctx->cols_known = FALSE;
+  ctx->redraw = TRUE;
+}
+
+/**
+ * Returns the width of the terminal the timers print on. It is measured
+ * once, then again only after ut_context_resized().
+ */
+gushort ut_context_get_cols(ut_context *ctx)
+{
+  g_assert(ctx);
+
+  if (!ctx->cols_known)
+  {
+    ctx->cols = get_terminal_width();
+    ctx->cols_known = TRUE;
+    g_debug("%s: terminal is %d columns wide", __FUNCTION__, ctx->cols);
+  }
+
+  return ctx->cols;
+}
@@ -0,0 +1,45 @@
+/*
+ *  context.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTEXT_H
+  #define CONTEXT_H
+
+  #include <glib.h>
+  #include "libutimer.h"
+
+/* What the timers running on one GMainContext share. Nothing in it is
+ * locked: a context, and the timers and batches using it, belong to the
+ * thread running its main context. Several threads each run their own. */
+struct _ut_context
+{
+  GMainContext *main_context; // where the sources of the timers are attached
+  GSList *wheels; // timing wheels in use, one per clock source (see wheel.c)
+  gboolean quiet; // the timers do not print
+  gboolean redraw; // the next printed frame is drawn in full
+  gushort cols; // width of the terminal, measured when cols_known is FALSE
+  gboolean cols_known;
+};
+
+gushort ut_context_get_cols(ut_context *ctx);
+
+#endif /* CONTEXT_H */
@@ -0,0 +1,307 @@
+/*
+ *  deadline.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <glib.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+  #include <sys/timerfd.h>
+#endif
+
+#include "deadline.h"
+
+/*
+ * A deadline source is a one-shot GSource that dispatches once an absolute
+ * deadline of a clock source has been reached. When timerfd is available the
+ * kernel does the waiting, so the main loop does not wake up at all before
+ * the deadline. Otherwise the main loop poll timeout is used instead.
+ * On a virtual clock source nothing waits: the earliest deadline is due
+ * right away, and the clock source jumps to it.
+ * On CLOCK_BOOTTIME, the timerfd follows CLOCK_BOOTTIME too: it keeps
+ * counting while the machine is suspended, and the kernel wakes us up right
+ * on resume when the deadline passed in between.
+ * On CLOCK_REALTIME, the timerfd follows the wall clock, and also wakes us
+ * up (once) when the wall clock is set, so the callback can check whether
+ * its deadline still makes sense.
+ */
+typedef struct
+{
+  GSource source;
+  GPollFD pollfd;
+  ut_clock_source *clock;
+  gboolean absolute; // the timerfd follows the clock source itself
+  gint64 deadline;
+  gint64 fired; // the deadline being dispatched, DEADLINE_NONE otherwise
+} deadline_source;
+
+/* Makes the virtual clock source of ds jump to its deadline, unless another
+ * deadline source on that clock is due before. */
+static gboolean deadline_source_jump(deadline_source *ds)
+{
+  ut_clock_source *clock = ds->clock;
+  GSList *l;
+
+  if (ds->deadline <= clock->now)
+    return TRUE;
+
+  for (l = clock->deadlines; l; l = l->next)
+  {
+    deadline_source *other = l->data;
+
+    if (other->deadline != DEADLINE_NONE && other->deadline < ds->deadline
+        && !g_source_is_destroyed((GSource *) other))
+      return FALSE;
+  }
+
+  g_debug("%s: jumping %" G_GINT64_FORMAT " ns forward", __FUNCTION__, ds->deadline - clock->now);
+  clock->now = ds->deadline;
+  return TRUE;
+}
+
+static gboolean deadline_source_prepare(GSource *source, gint *timeout)
+{
+  deadline_source *ds = (deadline_source *) source;
+  gint64 left;
+
+  *timeout = -1;
+
+  if (ds->deadline == DEADLINE_NONE)
+    return FALSE;
+
+  if (ds->clock->type == UT_CLOCK_SOURCE_VIRTUAL)
+    return deadline_source_jump(ds);
+
+  left = ds->deadline - ut_clock_source_now(ds->clock);
+  if (left <= 0)
+    return TRUE;
+
+  // without timerfd, the poll timeout does the waiting (rounded up to the ms)
+  if (ds->pollfd.fd < 0)
+    *timeout = (gint) MIN((left + DEADLINE_NSEC_PER_MSEC - 1) / DEADLINE_NSEC_PER_MSEC, G_MAXINT);
+
+  return FALSE;
+}
+
+static gboolean deadline_source_check(GSource *source)
+{
+  deadline_source *ds = (deadline_source *) source;
+  gboolean due = ds->deadline != DEADLINE_NONE && ut_clock_source_now(ds->clock) >= ds->deadline;
+
+  if (ds->pollfd.revents & G_IO_IN)
+  {
+    guint64 expirations;
+
+    // drain the timerfd, otherwise it would stay readable
+    if (read(ds->pollfd.fd, &expirations, sizeof(expirations)) < 0)
+    {
+      // the wall clock was set: dispatch, the callback has to arm it again
+      if (errno == ECANCELED && ds->deadline != DEADLINE_NONE)
+      {
+        g_debug("%s: the clock was set", __FUNCTION__);
+        return TRUE;
+      }
+      g_debug("%s: nothing to read from timerfd", __FUNCTION__);
+    }
+
+    // another clock than the timerfd one may not be there yet: wait again
+    if (!due && ds->deadline != DEADLINE_NONE)
+      deadline_source_set(source, ds->deadline);
+  }
+
+  return due;
+}
+
+static gboolean deadline_source_dispatch(GSource *source,
+                                         GSourceFunc callback,
+                                         gpointer user_data)
+{
+  deadline_source *ds = (deadline_source *) source;
+  gboolean ret;
+
+  // one-shot: disarm before calling back, the callback may arm it again
+  ds->fired = ds->deadline;
+  ds->deadline = DEADLINE_NONE;
+
+  if (!callback)
+    return FALSE;
+
+  ret = callback(user_data);
+  ds->fired = DEADLINE_NONE;
+  return ret;
+}
+
+static void deadline_source_finalize(GSource *source)
+{
+  deadline_source *ds = (deadline_source *) source;
+
+  if (ds->pollfd.fd >= 0)
+  {
+    close(ds->pollfd.fd);
+    ds->pollfd.fd = -1;
+  }
+
+  ds->clock->deadlines = g_slist_remove(ds->clock->deadlines, ds);
+}
+
+static GSourceFuncs deadline_source_funcs = {
+  deadline_source_prepare,
+  deadline_source_check,
+  deadline_source_dispatch,
+  deadline_source_finalize
+};
+
+/**
+ * Creates a new, disarmed, deadline source on the given clock source.
+ * Use deadline_source_set() to arm it and g_source_set_callback() to choose
+ * what is called when the deadline is reached. The source is disarmed
+ * before dispatching, so the callback has to arm it again if needed.
+ */
+GSource* deadline_source_new(ut_clock_source *clock)
+{
+  GSource *source = g_source_new(&deadline_source_funcs, sizeof(deadline_source));
+  deadline_source *ds = (deadline_source *) source;
+
+  g_assert(clock);
+
+  ds->clock = clock;
+  ds->absolute = FALSE;
+  ds->deadline = DEADLINE_NONE;
+  ds->fired = DEADLINE_NONE;
+  ds->pollfd.fd = -1;
+  ds->pollfd.events = G_IO_IN;
+  ds->pollfd.revents = 0;
+
+  if (clock->type == UT_CLOCK_SOURCE_VIRTUAL)
+  {
+    clock->deadlines = g_slist_prepend(clock->deadlines, ds);
+    return source;
+  }
+
+#ifdef HAVE_SYS_TIMERFD_H
+  #ifdef CLOCK_BOOTTIME
+  // timerfd supports CLOCK_BOOTTIME since Linux 3.15
+  if (clock->type == UT_CLOCK_SOURCE_BOOTTIME)
+  {
+    ds->pollfd.fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ds->pollfd.fd >= 0)
+      ds->absolute = TRUE;
+    else
+      g_debug("%s: no CLOCK_BOOTTIME timerfd, time spent suspended delays the deadline", __FUNCTION__);
+  }
+  #endif
+
+  if (clock->type == UT_CLOCK_SOURCE_REALTIME)
+  {
+    ds->pollfd.fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    ds->absolute = (ds->pollfd.fd >= 0);
+  }
+
+  if (ds->pollfd.fd < 0)
+  {
+    ds->pollfd.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ds->absolute = (clock->type == UT_CLOCK_SOURCE_MONOTONIC);
+  }
+
+  if (ds->pollfd.fd >= 0)
+    g_source_add_poll(source, &ds->pollfd);
+  else
+    g_debug("%s: timerfd_create failed, falling back to poll timeouts", __FUNCTION__);
+#endif
+
+  return source;
+}
+
+/**
+ * Arms the source to dispatch at the given deadline.
+ * @param deadline absolute time of the clock source in nanoseconds (see
+ * ut_clock_source_now()), or DEADLINE_NONE to disarm the source.
+ */
+void deadline_source_set(GSource *source, gint64 deadline)
+{
+  deadline_source *ds = (deadline_source *) source;
+
+  g_assert(ds);
+
+  ds->deadline = (deadline < 0 ? DEADLINE_NONE : deadline);
+
+#ifdef HAVE_SYS_TIMERFD_H
+  if (ds->pollfd.fd >= 0)
+  {
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    gint64 value = ds->deadline;
+    gint flags = TFD_TIMER_ABSTIME;
+
+    /* when the timerfd follows CLOCK_MONOTONIC instead of the clock source,
+     * the deadline is converted to a relative time */
+    if (ds->deadline != DEADLINE_NONE && !ds->absolute)
+    {
+      value = ds->deadline - ut_clock_source_now(ds->clock);
+      flags = 0;
+    }
+
+    #ifdef TFD_TIMER_CANCEL_ON_SET
+    if (ds->clock->type == UT_CLOCK_SOURCE_REALTIME && ds->absolute)
+      flags |= TFD_TIMER_CANCEL_ON_SET;
+    #endif
+
+    if (ds->deadline != DEADLINE_NONE)
+    {
+      value = MAX(value, 0);
+      its.it_value.tv_sec = value / DEADLINE_NSEC_PER_SEC;
+      its.it_value.tv_nsec = value % DEADLINE_NSEC_PER_SEC;
+      // a zero it_value would disarm the timerfd
+      if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(ds->pollfd.fd, flags, &its, NULL) < 0)
+      g_debug("%s: timerfd_settime failed", __FUNCTION__);
+  }
+#endif
+}
+
+/**
+ * Returns the deadline the source is armed with, or DEADLINE_NONE.
+ */
+gint64 deadline_source_get(GSource *source)
+{
+  g_assert(source);
+  return ((deadline_source *) source)->deadline;
+}
+
+/**
+ * Returns the deadline that made the source dispatch, when called from its
+ * callback (e.g. to know how late it woke up). Returns DEADLINE_NONE
+ * anywhere else.
+ */
+gint64 deadline_source_get_fired(GSource *source)
+{
+  g_assert(source);
+  return ((deadline_source *) source)->fired;
+}
@@ -0,0 +1,40 @@
+/*
+ *  deadline.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEADLINE_H
+  #define DEADLINE_H
+
+  #include <glib.h>
+  #include "clock.h"
+
+  #define DEADLINE_NONE          (-1)
+  #define DEADLINE_NSEC_PER_SEC  G_GINT64_CONSTANT(1000000000)
+  #define DEADLINE_NSEC_PER_MSEC G_GINT64_CONSTANT(1000000)
+  #define DEADLINE_NSEC_PER_USEC G_GINT64_CONSTANT(1000)
+
+GSource* deadline_source_new(ut_clock_source *clock);
+void deadline_source_set(GSource *source, gint64 deadline);
+gint64 deadline_source_get(GSource *source);
+gint64 deadline_source_get_fired(GSource *source);
+
+#endif /* DEADLINE_H */
@@ -0,0 +1,133 @@
+/*
+ *  libutimer.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The public interface of libutimer: countdowns, timers and stopwatches that
+ * run on the GLib main loop of the process that uses them, without spawning
+ * utimer. Everything else in the sources is internal and may change.
+ * Build with: pkg-config --cflags --libs utimer
+ *
+ * Timers run on the GMainContext of the ut_context they are created with:
+ * run a GMainLoop on it, and once a timer or countdown is started with
+ * ut_timer_start(), its success callback is called when its length has
+ * elapsed (stopwatches never expire), or its error callback right away if
+ * it cannot wait for that (see ut_timer_new_timer()). A ut_clock counts
+ * from its creation until ut_timer_start() or ut_clock_start() reset it to
+ * 0. There is no global state: threads running their own GMainContext, each
+ * with its own ut_context, run their timers independently and without
+ * locking. Times are in nanoseconds.
+ */
+
+#ifndef LIBUTIMER_H
+  #define LIBUTIMER_H
+
+  #include <glib.h>
+
+  #define UT_NSEC_PER_SEC  G_GINT64_CONSTANT(1000000000)
+  #define UT_NSEC_PER_MSEC G_GINT64_CONSTANT(1000000)
+  #define UT_NSEC_PER_USEC G_GINT64_CONSTANT(1000)
+  #define UT_DURATION_MAX  G_MAXINT64
+
+G_BEGIN_DECLS
+
+/* A length of time, in nanoseconds (enough for about 292 years) */
+typedef gint64 ut_duration;
+
+typedef enum
+{
+  TIMER_PRECISION_DEFAULT,
+  TIMER_PRECISION_NANOSECOND,
+  TIMER_PRECISION_MICROSECOND,
+  TIMER_PRECISION_MILLISECOND,
+  TIMER_PRECISION_SECOND,
+  TIMER_PRECISION_MINUTE,
+  TIMER_PRECISION_HOUR
+} timer_precision;
+
+typedef struct
+{
+  gboolean perc: 1, text: 1, bar: 1;
+} timer_display;
+
+/* What the timers running on one GMainContext share */
+typedef struct _ut_context ut_context;
+
+/* What a timer measures its time with (a pausable stopwatch) */
+typedef struct _ut_clock ut_clock;
+
+typedef struct _ut_timer ut_timer;
+
+/* Called from the main loop, with the user_data given to the timer. */
+typedef void (*timer_func)(ut_timer *t, gpointer user_data);
+
+ut_context* ut_context_new(GMainContext *main_context);
+void ut_context_free(ut_context *ctx);
+GMainContext* ut_context_get_main_context(const ut_context *ctx);
+void ut_context_set_quiet(ut_context *ctx, gboolean quiet);
+void ut_context_redraw(ut_context *ctx);
+void ut_context_resized(ut_context *ctx);
+
+ut_clock* ut_clock_new();
+void ut_clock_destroy(ut_clock *c);
+void ut_clock_start(ut_clock *c);
+
+ut_timer* ut_timer_new_timer(ut_duration length,
+                             timer_func success_callback,
+                             timer_func error_callback,
+                             gpointer user_data,
+                             ut_context* context,
+                             ut_clock* clock,
+                             timer_precision precision,
+                             const timer_display* display);
+ut_timer* ut_timer_new_countdown(ut_duration length,
+                                 timer_func success_callback,
+                                 timer_func error_callback,
+                                 gpointer user_data,
+                                 ut_context* context,
+                                 ut_clock* clock,
+                                 timer_precision precision,
+                                 const timer_display* display);
+ut_timer* ut_timer_new_stopwatch(timer_func success_callback,
+                                 timer_func error_callback,
+                                 gpointer user_data,
+                                 ut_context* context,
+                                 ut_clock* clock,
+                                 timer_precision precision,
+                                 const timer_display* display);
+gboolean ut_timer_destroy(ut_timer* t);
+
+void ut_timer_start(ut_timer *t);
+void ut_timer_pause(ut_timer *t);
+void ut_timer_resume(ut_timer *t);
+
+gboolean ut_timer_is_paused(const ut_timer *t);
+gboolean ut_timer_has_expired(const ut_timer *t);
+ut_duration ut_timer_get_elapsed(const ut_timer *t);
+ut_duration ut_timer_get_remaining(const ut_timer *t);
+gint8 ut_timer_get_progress_percent(const ut_timer *t);
+
+gboolean ut_parse_time_pattern(gchar *pattern, ut_duration *duration);
+
+G_END_DECLS
+
+#endif /* LIBUTIMER_H */
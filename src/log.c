@@ -25,53 +25,84 @@
 #  include <config.h>
 #endif
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
-#include "utimer.h"
 #include "log.h"
-#include "utils.h"
+
+/* The message went over the line of the timer: it is drawn again in full */
+static void log_redraw (Config *conf)
+{
+  if (conf->context)
+    ut_context_redraw(conf->context);
+}
+
+/* Prints a message where conf says, right away: the timer line and the
+ * records are written to the same terminal or pipe with write(), so a
+ * message left in the stdio buffer would come out after them. When stdout
+ * carries records, the messages go to stderr instead, so that they do not
+ * break the stream. */
+static void log_print (Config *conf, const gchar *format, ...)
+{
+  FILE *out = conf->log_to_stderr ? stderr : stdout;
+  va_list args;
+
+  va_start (args, format);
+  vfprintf (out, format, args);
+  va_end (args);
+  fflush (out);
+  log_redraw(conf);
+}
 
 static void log_handler (const gchar *log_domain,
                         GLogLevelFlags log_level,
                         const gchar *message,
                         gpointer user_data)
 {
+  Config *conf = user_data;
 
   if ((log_level & G_LOG_LEVEL_MESSAGE))
   {
-    if (!ut_config.quiet)
-      g_print ("%s", message); /* There is no new line.
-                               * (must be handled when calling g_message) */
+    if (!conf->quiet)
+    {
+      log_print (conf, "%s", message); /* There is no new line.
+                                       * (must be handled when calling g_message) */
+    }
     return;
   }
 
   if ((log_level & G_LOG_LEVEL_INFO))
   {
-    if (!ut_config.quiet && ut_config.verbose)
-      g_print ("%s\n", message);
+    if (!conf->quiet && conf->verbose)
+    {
+      log_print (conf, "%s\n", message);
+    }
     return;
   }
 
   if ((log_level & G_LOG_LEVEL_DEBUG))
   {
-    if (ut_config.debug)
-      g_print ("** DEBUG: %s\n", message);
+    if (conf->debug)
+    {
+      log_print (conf, "** DEBUG: %s\n", message);
+    }
     return;
   }
 
   if ((log_level & G_LOG_LEVEL_WARNING))
   {
-    g_print (_("** WARNING: %s\n"), message);
+    log_print (conf, _("** WARNING: %s\n"), message);
     return;
   }
 
 }
 
 
-/* set up the verbose/debug log handler */
-void setup_log_handler ()
+/* set up the verbose/debug log handler, following the options of conf */
+void setup_log_handler (Config *conf)
 {
   g_log_set_handler (NULL,
                      G_LOG_LEVEL_INFO
@@ -79,5 +110,5 @@ void setup_log_handler ()
                       | G_LOG_LEVEL_DEBUG
                       | G_LOG_LEVEL_WARNING,
                      log_handler,
-                     NULL);
+                     conf);
 }
@@ -23,10 +23,12 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include "utimer.h"
+
 #ifndef g_info
 #define g_info(format...) g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, format)
 #endif
 
-
+void setup_log_handler(Config *conf);
 
 #endif /* LOG_H */
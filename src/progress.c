@@ -21,4 +21,275 @@
  *
  */
 
-#include "progress.h"
\ No newline at end of file
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "utils.h"
+#include "progress.h"
+
+/**
+ * Creates an empty frame. Its line is allocated by progress_frame_reset().
+ */
+progress_frame* progress_frame_new()
+{
+  progress_frame *frame = g_new(progress_frame, 1);
+
+  frame->line = NULL;
+  frame->size = 0;
+  frame->len = 0;
+
+  return frame;
+}
+
+void progress_frame_free(progress_frame *frame)
+{
+  if (!frame)
+    return;
+
+  g_free(frame->line);
+  g_free(frame);
+}
+
+/**
+ * Empties the frame and makes room for width characters.
+ * The line is only reallocated when it grows (i.e. when the terminal gets
+ * wider), so in steady state this does not allocate.
+ */
+void progress_frame_reset(progress_frame *frame, gsize width)
+{
+  g_assert(frame);
+
+  if (G_UNLIKELY(frame->size < width + 1))
+  {
+    frame->line = g_realloc(frame->line, width + 1);
+    frame->size = width + 1;
+  }
+
+  frame->len = 0;
+  frame->line[0] = '\0';
+}
+
+/**
+ * Appends len bytes of str to the frame.
+ * Returns FALSE (and leaves the frame untouched) if it does not fit.
+ */
+gboolean progress_frame_append(progress_frame *frame, const gchar *str, gsize len)
+{
+  if (frame->len + len >= frame->size)
+    return FALSE;
+
+  memcpy(frame->line + frame->len, str, len);
+  frame->len += len;
+  frame->line[frame->len] = '\0';
+
+  return TRUE;
+}
+
+/**
+ * Appends a progress bar of the given width to the frame (see
+ * fill_progress_bar()). Returns FALSE if it does not fit.
+ */
+gboolean progress_frame_append_bar(progress_frame *frame, gint8 perc, gushort width, gboolean go_right)
+{
+  if (frame->len + width >= frame->size)
+    return FALSE;
+
+  fill_progress_bar(frame->line + frame->len, perc, width, go_right);
+  frame->len += width;
+
+  return TRUE;
+}
+
+/**
+ * Creates a renderer drawing to the file descriptor fd (usually
+ * STDOUT_FILENO). The first frame is fully drawn. If fd is not a terminal,
+ * frames are written as they are, without any escape sequence.
+ */
+progress_renderer* progress_renderer_new(gint fd)
+{
+  progress_renderer *r = g_new(progress_renderer, 1);
+
+  r->fd = fd;
+  r->screen = progress_frame_new();
+  r->out = NULL;
+  r->out_size = 0;
+  r->out_len = 0;
+  r->invalid = TRUE;
+  r->plain = (fd >= 0 && !isatty(fd));
+  r->bytes_written = 0;
+
+  return r;
+}
+
+void progress_renderer_free(progress_renderer *r)
+{
+  if (!r)
+    return;
+
+  progress_frame_free(r->screen);
+  g_free(r->out);
+  g_free(r);
+}
+
+/**
+ * Forgets what is on the screen, so the next frame is fully redrawn.
+ * This is needed when something else wrote to the terminal, or when it was
+ * resized.
+ */
+void progress_renderer_invalidate(progress_renderer *r)
+{
+  r->invalid = TRUE;
+}
+
+static void renderer_put(progress_renderer *r, const gchar *str, gsize len)
+{
+  memcpy(r->out + r->out_len, str, len);
+  r->out_len += len;
+}
+
+/* Moves the cursor forward by cols columns. */
+static void renderer_move(progress_renderer *r, gsize cols)
+{
+  if (cols > 0)
+    r->out_len += g_snprintf(r->out + r->out_len, r->out_size - r->out_len,
+                             "\033[%" G_GSIZE_FORMAT "C", cols);
+}
+
+/* Number of columns taken by len bytes of UTF-8 text. */
+static gsize utf8_columns(const gchar *str, gsize len)
+{
+  gsize i, cols = 0;
+
+  for (i = 0; i < len; i++)
+    if (((guchar) str[i] & 0xC0) != 0x80)
+      cols++;
+
+  return cols;
+}
+
+/**
+ * Computes what needs to be written to turn the screen into line.
+ * The result is left in r->out (r->out_len bytes, nothing to write if the
+ * line did not change) and the screen is updated as if it was written.
+ * Each run of changed characters is reached with a cursor movement, and
+ * the cursor is left at the end of the line, like after a full redraw.
+ * @return the number of bytes to write
+ */
+gsize progress_renderer_update(progress_renderer *r, const gchar *line, gsize len)
+{
+  const gchar *old = r->screen->line;
+  gsize old_len = r->screen->len;
+  gsize common = MIN(len, old_len);
+  gsize i = 0, col = 0;
+
+  // worst case: a cursor movement for every few bytes, plus the line erase
+  if (G_UNLIKELY(r->out_size < 2 * (len + old_len) + 32))
+  {
+    r->out_size = 2 * (len + old_len) + 32;
+    r->out = g_realloc(r->out, r->out_size);
+  }
+  r->out_len = 0;
+
+  if (r->plain)
+    renderer_put(r, line, len);
+  else if (r->invalid || old_len == 0)
+  {
+    renderer_put(r, "\r", 1);
+    renderer_put(r, line, len);
+    renderer_put(r, "\033[K", 3);
+  }
+  else
+  {
+    while (i < len)
+    {
+      gsize start, end, gap, j;
+
+      if (i < common && line[i] == old[i])
+      {
+        i++;
+        continue;
+      }
+
+      // go back to the beginning of a multibyte character
+      start = i;
+      while (start > 0 && ((guchar) line[start] & 0xC0) == 0x80)
+        start--;
+
+      // find the end of this change, including the short unchanged gaps
+      end = i + 1;
+      gap = 0;
+      for (j = end; j < len && gap <= PROGRESS_MAX_REWRITE_GAP; j++)
+      {
+        if (j < common && line[j] == old[j])
+          gap++;
+        else
+        {
+          end = j + 1;
+          gap = 0;
+        }
+      }
+      while (end < len && ((guchar) line[end] & 0xC0) == 0x80)
+        end++;
+
+      if (r->out_len == 0)
+        renderer_put(r, "\r", 1);
+      renderer_move(r, utf8_columns(line + col, start - col));
+      renderer_put(r, line + start, end - start);
+      col = end;
+      i = end;
+    }
+
+    if (len < old_len)
+    {
+      if (r->out_len == 0)
+        renderer_put(r, "\r", 1);
+      renderer_move(r, utf8_columns(line + col, len - col));
+      renderer_put(r, "\033[K", 3);
+    }
+    else if (r->out_len > 0)
+      renderer_move(r, utf8_columns(line + col, len - col));
+  }
+
+  progress_frame_reset(r->screen, len);
+  progress_frame_append(r->screen, line, len);
+  r->invalid = FALSE;
+
+  return r->out_len;
+}
+
+/**
+ * Draws the frame, writing only what changed since the last one.
+ * @return FALSE if writing failed
+ */
+gboolean progress_renderer_draw(progress_renderer *r, const progress_frame *frame)
+{
+  gsize done = 0;
+
+  progress_renderer_update(r, frame->line, frame->len);
+
+  while (done < r->out_len)
+  {
+    gssize n = write(r->fd, r->out + done, r->out_len - done);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      // we don't know what made it to the screen
+      r->invalid = TRUE;
+      return FALSE;
+    }
+
+    done += n;
+  }
+
+  r->bytes_written += done;
+  return TRUE;
+}
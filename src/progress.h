@@ -26,7 +26,45 @@
 #ifndef _PROGRESS_H
   #define	_PROGRESS_H
 
+  #include <glib.h>
 
+  /* unchanged bytes between two changes are rewritten rather than skipped
+   * when the cursor movement would not be shorter */
+  #define PROGRESS_MAX_REWRITE_GAP 4
+
+/* A reusable line buffer: once it is big enough for the terminal width,
+ * building a new frame does not allocate any memory. */
+typedef struct
+{
+  gchar *line;
+  gsize size; /* allocated size of line */
+  gsize len;  /* length of the current frame */
+} progress_frame;
+
+/* Keeps what is on the screen and only rewrites what changed in a new
+ * frame, moving the cursor over the rest. */
+typedef struct
+{
+  gint fd;
+  progress_frame *screen; /* the line as it is on the screen */
+  gchar *out;             /* escape sequences and text to write */
+  gsize out_size;
+  gsize out_len;
+  gboolean invalid;       /* if TRUE, the next frame is fully redrawn */
+  gboolean plain;         /* not a terminal: write lines without escapes */
+  guint64 bytes_written;
+} progress_renderer;
+
+progress_frame* progress_frame_new();
+void progress_frame_free(progress_frame *frame);
+void progress_frame_reset(progress_frame *frame, gsize width);
+gboolean progress_frame_append(progress_frame *frame, const gchar *str, gsize len);
+gboolean progress_frame_append_bar(progress_frame *frame, gint8 perc, gushort width, gboolean go_right);
+progress_renderer* progress_renderer_new(gint fd);
+void progress_renderer_free(progress_renderer *r);
+void progress_renderer_invalidate(progress_renderer *r);
+gsize progress_renderer_update(progress_renderer *r, const gchar *line, gsize len);
+gboolean progress_renderer_draw(progress_renderer *r, const progress_frame *frame);
 
 #endif	/* _PROGRESS_H */
 
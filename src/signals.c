@@ -0,0 +1,251 @@
+/*
+ *  signals.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#ifdef HAVE_SYS_SIGNALFD_H
+  #include <sys/signalfd.h>
+#endif
+
+#include "signals.h"
+
+/*
+ * A signal source dispatches the signals sent to the process from the main
+ * loop, so that what is done about them does not have to be
+ * async-signal-safe (quitting the main loop, logging, measuring the
+ * terminal...). With signalfd, the signals are blocked and the kernel
+ * queues them on a file descriptor polled by the main loop: no handler runs
+ * at all. Otherwise, a handler only writes the signal number to a pipe
+ * (write() is async-signal-safe) polled instead. That pipe belongs to the
+ * process, so without signalfd there should be a single signal source.
+ * The signals are blocked with pthread_sigmask(), for the calling thread
+ * and the threads it starts afterwards, which inherit its mask. A signal
+ * sent to a thread that does not block it takes its default action, so the
+ * source has to be created before any thread is started (or every thread
+ * has to block its signals). Once the source is freed, the signals still
+ * pending are dropped and the mask is restored: the signals that were
+ * blocked before stay blocked.
+ */
+typedef struct
+{
+  GSource source;
+  GPollFD pollfd;
+  sigset_t mask;
+  sigset_t unblock; // the signals of mask that were not blocked before
+  gboolean blocked; // the signals are read from a signalfd
+  struct sigaction *old_actions; // replaced by the pipe handler, by signal
+} signal_source;
+
+static gint signal_pipe[2] = { -1, -1 };
+
+static void signal_pipe_handler(gint signum)
+{
+  guchar c = (guchar) signum;
+  gint saved_errno = errno;
+  gssize n;
+
+  // failing with EAGAIN, the pipe is full: enough signals are waiting
+  do
+    n = write(signal_pipe[1], &c, 1);
+  while (n < 0 && errno == EINTR);
+
+  errno = saved_errno;
+}
+
+/* Installs the pipe handler for the signals of ss, and polls the pipe. */
+static gboolean signal_source_open_pipe(signal_source *ss)
+{
+  struct sigaction action;
+  gint signum, i;
+
+  if (signal_pipe[0] < 0)
+  {
+    if (pipe(signal_pipe) < 0)
+      return FALSE;
+
+    for (i = 0; i < 2; i++)
+    {
+      fcntl(signal_pipe[i], F_SETFL, fcntl(signal_pipe[i], F_GETFL) | O_NONBLOCK);
+      fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = signal_pipe_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  ss->old_actions = g_new0(struct sigaction, NSIG);
+  for (signum = 1; signum < NSIG; signum++)
+    if (sigismember(&ss->mask, signum) == 1)
+      sigaction(signum, &action, &ss->old_actions[signum]);
+
+  ss->pollfd.fd = signal_pipe[0];
+  return TRUE;
+}
+
+/* Returns the next signal waiting on ss, or 0 if there is none. */
+static gint signal_source_next(signal_source *ss)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+  if (ss->blocked)
+  {
+    struct signalfd_siginfo info;
+
+    if (read(ss->pollfd.fd, &info, sizeof(info)) != sizeof(info))
+      return 0;
+    return (gint) info.ssi_signo;
+  }
+#endif
+
+  {
+    guchar c;
+
+    if (read(ss->pollfd.fd, &c, 1) != 1)
+      return 0;
+    return c;
+  }
+}
+
+static gboolean signal_source_prepare(GSource *source, gint *timeout)
+{
+  *timeout = -1;
+  return FALSE;
+}
+
+static gboolean signal_source_check(GSource *source)
+{
+  signal_source *ss = (signal_source *) source;
+
+  return (ss->pollfd.revents & G_IO_IN) != 0;
+}
+
+static gboolean signal_source_dispatch(GSource *source,
+                                       GSourceFunc callback,
+                                       gpointer user_data)
+{
+  signal_source *ss = (signal_source *) source;
+  gint signum;
+
+  while ((signum = signal_source_next(ss)) > 0)
+  {
+    g_debug("%s: signal %d", __FUNCTION__, signum);
+    if (callback && !((signal_func) callback)(signum, user_data))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void signal_source_finalize(GSource *source)
+{
+  signal_source *ss = (signal_source *) source;
+  gint signum;
+
+  if (ss->blocked)
+  {
+    // once unblocked, they would take their default action (e.g. terminate)
+    while ((signum = signal_source_next(ss)) > 0)
+      g_debug("%s: dropping signal %d", __FUNCTION__, signum);
+
+    close(ss->pollfd.fd);
+    pthread_sigmask(SIG_UNBLOCK, &ss->unblock, NULL);
+    return;
+  }
+
+  if (!ss->old_actions)
+    return;
+
+  for (signum = 1; signum < NSIG; signum++)
+    if (sigismember(&ss->mask, signum) == 1)
+      sigaction(signum, &ss->old_actions[signum], NULL);
+  g_free(ss->old_actions);
+}
+
+static GSourceFuncs signal_source_funcs = {
+  signal_source_prepare,
+  signal_source_check,
+  signal_source_dispatch,
+  signal_source_finalize
+};
+
+/**
+ * Creates a new source receiving the given signals, instead of their
+ * default action. Use g_source_set_callback() with a signal_func to choose
+ * what is called, from the main loop, for each signal received.
+ * Create it before starting any thread (see signal_source above).
+ */
+GSource* signal_source_new(const gint *signals, guint count)
+{
+  GSource *source = g_source_new(&signal_source_funcs, sizeof(signal_source));
+  signal_source *ss = (signal_source *) source;
+  sigset_t old_mask;
+  guint i;
+
+  sigemptyset(&ss->mask);
+  sigemptyset(&ss->unblock);
+  for (i = 0; i < count; i++)
+    sigaddset(&ss->mask, signals[i]);
+
+  ss->blocked = FALSE;
+  ss->old_actions = NULL;
+  ss->pollfd.fd = -1;
+  ss->pollfd.events = G_IO_IN;
+  ss->pollfd.revents = 0;
+
+#ifdef HAVE_SYS_SIGNALFD_H
+  // blocked signals stay pending, and the signalfd reads them
+  if (pthread_sigmask(SIG_BLOCK, &ss->mask, &old_mask) == 0)
+  {
+    for (i = 0; i < count; i++)
+      if (sigismember(&old_mask, signals[i]) == 0)
+        sigaddset(&ss->unblock, signals[i]);
+
+    ss->pollfd.fd = signalfd(-1, &ss->mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    ss->blocked = (ss->pollfd.fd >= 0);
+    if (!ss->blocked)
+    {
+      g_debug("%s: signalfd failed, falling back to a pipe", __FUNCTION__);
+      pthread_sigmask(SIG_UNBLOCK, &ss->unblock, NULL);
+    }
+  }
+#endif
+
+  if (!ss->blocked && !signal_source_open_pipe(ss))
+    g_debug("%s: cannot create the signal pipe, signals are not caught", __FUNCTION__);
+
+  if (ss->pollfd.fd >= 0)
+    g_source_add_poll(source, &ss->pollfd);
+
+  return source;
+}
@@ -0,0 +1,35 @@
+/*
+ *  signals.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SIGNALS_H
+  #define SIGNALS_H
+
+  #include <glib.h>
+
+/* Called from the main loop for each signal received by a signal source.
+ * Returning FALSE removes the source. */
+typedef gboolean (*signal_func)(gint signum, gpointer user_data);
+
+GSource* signal_source_new(const gint *signals, guint count);
+
+#endif /* SIGNALS_H */
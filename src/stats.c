@@ -0,0 +1,108 @@
+/*
+ *  stats.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "stats.h"
+
+/* Returns the bucket of the given value (see stats_histogram). */
+static guint stats_bucket_index(guint64 value)
+{
+  guint exp;
+
+  if (value < STATS_SUB_BUCKETS)
+    return (guint) value;
+
+  // position of the highest bit (g_bit_storage() takes a gulong)
+  if (value >> 32)
+    exp = g_bit_storage((gulong) (value >> 32)) + 31;
+  else
+    exp = g_bit_storage((gulong) value) - 1;
+  return (exp - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS
+         + (guint) ((value >> (exp - STATS_SUB_BUCKET_BITS)) & (STATS_SUB_BUCKETS - 1));
+}
+
+/* Returns the highest value that goes into the given bucket. */
+static guint64 stats_bucket_upper(guint index)
+{
+  guint exp;
+  guint64 sub;
+
+  if (index < STATS_SUB_BUCKETS)
+    return index;
+
+  exp = index / STATS_SUB_BUCKETS + STATS_SUB_BUCKET_BITS - 1;
+  sub = STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS;
+  return ((sub + 1) << (exp - STATS_SUB_BUCKET_BITS)) - 1;
+}
+
+void stats_histogram_init(stats_histogram *h)
+{
+  memset(h, 0, sizeof(stats_histogram));
+}
+
+/**
+ * Adds a value to the histogram. Negative values count as 0.
+ * This does not allocate and takes constant time.
+ */
+void stats_histogram_record(stats_histogram *h, ut_duration value)
+{
+  if (value < 0)
+    value = 0;
+
+  h->buckets[stats_bucket_index(value)]++;
+  h->count++;
+  if (value > h->max)
+    h->max = value;
+}
+
+/**
+ * Returns the value below which the given percentage (0 to 100) of the
+ * recorded values are, rounded up to the end of its bucket (and never above
+ * the maximum). Returns 0 if nothing was recorded.
+ */
+ut_duration stats_histogram_percentile(const stats_histogram *h, gdouble percentile)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  if (h->count == 0)
+    return 0;
+
+  rank = (guint64) (percentile / 100 * h->count + 0.5);
+  rank = CLAMP(rank, 1, h->count);
+
+  for (i = 0; i < STATS_BUCKETS; i++)
+  {
+    seen += h->buckets[i];
+    if (seen >= rank)
+      return MIN((ut_duration) stats_bucket_upper(i), h->max);
+  }
+
+  return h->max;
+}
@@ -0,0 +1,48 @@
+/*
+ *  stats.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STATS_H
+  #define STATS_H
+
+  #include <glib.h>
+  #include "clock.h"
+
+  #define STATS_SUB_BUCKET_BITS 4 // 16 linear buckets per power of two (6% error)
+  #define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+  #define STATS_BUCKETS ((64 - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+/* A log-linear histogram of durations, in fixed memory: values below
+ * STATS_SUB_BUCKETS ns are exact, above that each power of two is split in
+ * STATS_SUB_BUCKETS buckets. */
+typedef struct
+{
+  guint32 buckets[STATS_BUCKETS];
+  guint64 count;
+  ut_duration max;
+} stats_histogram;
+
+void stats_histogram_init(stats_histogram *h);
+void stats_histogram_record(stats_histogram *h, ut_duration value);
+ut_duration stats_histogram_percentile(const stats_histogram *h, gdouble percentile);
+
+#endif /* STATS_H */
@@ -0,0 +1,177 @@
+/*
+ *  stream.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "stream.h"
+
+/**
+ * Parses the name of a stream format ("jsonl", "csv" or "tsv").
+ * Returns FALSE if the name is unknown.
+ */
+gboolean stream_format_from_string(const gchar *str, stream_format *format)
+{
+  g_return_val_if_fail(str && format, FALSE);
+
+  if (g_ascii_strcasecmp(str, "jsonl") == 0)
+    *format = STREAM_FORMAT_JSONL;
+  else if (g_ascii_strcasecmp(str, "csv") == 0)
+    *format = STREAM_FORMAT_CSV;
+  else if (g_ascii_strcasecmp(str, "tsv") == 0)
+    *format = STREAM_FORMAT_TSV;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Writes the header line of the given format into buf (CSV and TSV only).
+ * Returns the length of the header, 0 if the format has none.
+ */
+gsize stream_format_header(gchar *buf, gsize size, stream_format format)
+{
+  const gchar *sep;
+
+  if (format == STREAM_FORMAT_CSV)
+    sep = ",";
+  else if (format == STREAM_FORMAT_TSV)
+    sep = "\t";
+  else
+    return 0;
+
+  return g_snprintf(buf, size, "mode%selapsed_ns%sremaining_ns%spercent%spaused\n",
+                    sep, sep, sep, sep);
+}
+
+/**
+ * Writes one record, as a full line, into buf.
+ * Fields that do not apply are null (JSON) or empty (CSV and TSV).
+ * Returns the length of the line.
+ */
+gsize stream_format_record(gchar *buf, gsize size, stream_format format, const stream_record *record)
+{
+  gchar remaining[24] = "", perc[8] = "";
+  gint len;
+
+  if (format == STREAM_FORMAT_JSONL)
+  {
+    g_stpcpy(remaining, "null");
+    g_stpcpy(perc, "null");
+  }
+
+  if (record->remaining_ns >= 0)
+    g_snprintf(remaining, sizeof(remaining), "%" G_GINT64_FORMAT, record->remaining_ns);
+  if (record->perc >= 0)
+    g_snprintf(perc, sizeof(perc), "%d", record->perc);
+
+  if (format == STREAM_FORMAT_JSONL)
+    len = g_snprintf(buf, size,
+                     "{\"mode\":\"%s\",\"elapsed_ns\":%" G_GINT64_FORMAT
+                     ",\"remaining_ns\":%s,\"percent\":%s,\"paused\":%s}\n",
+                     record->mode, record->elapsed_ns, remaining, perc,
+                     record->paused ? "true" : "false");
+  else
+  {
+    const gchar *sep = (format == STREAM_FORMAT_TSV ? "\t" : ",");
+    len = g_snprintf(buf, size, "%s%s%" G_GINT64_FORMAT "%s%s%s%s%s%d\n",
+                     record->mode, sep, record->elapsed_ns, sep, remaining,
+                     sep, perc, sep, record->paused ? 1 : 0);
+  }
+
+  return MIN((gsize) len, size - 1);
+}
+
+/**
+ * Writes the header line of the completion records into buf (CSV and TSV
+ * only). Returns the length of the header, 0 if the format has none.
+ */
+gsize stream_format_completion_header(gchar *buf, gsize size, stream_format format)
+{
+  const gchar *sep;
+
+  if (format == STREAM_FORMAT_CSV)
+    sep = ",";
+  else if (format == STREAM_FORMAT_TSV)
+    sep = "\t";
+  else
+    return 0;
+
+  return g_snprintf(buf, size, "name%smode%srequested_ns%sactual_ns%slateness_ns\n",
+                    sep, sep, sep, sep);
+}
+
+/**
+ * Writes one completion record, as a full line, into buf. The name is
+ * written as is: it must not need quoting (see batch_read()).
+ * Returns the length of the line.
+ */
+gsize stream_format_completion(gchar *buf, gsize size, stream_format format, const stream_completion *completion)
+{
+  gint len;
+
+  if (format == STREAM_FORMAT_JSONL)
+    len = g_snprintf(buf, size,
+                     "{\"name\":\"%s\",\"mode\":\"%s\",\"requested_ns\":%" G_GINT64_FORMAT
+                     ",\"actual_ns\":%" G_GINT64_FORMAT ",\"lateness_ns\":%" G_GINT64_FORMAT "}\n",
+                     completion->name, completion->mode, completion->requested_ns,
+                     completion->actual_ns, completion->lateness_ns);
+  else
+  {
+    const gchar *sep = (format == STREAM_FORMAT_TSV ? "\t" : ",");
+    len = g_snprintf(buf, size, "%s%s%s%s%" G_GINT64_FORMAT "%s%" G_GINT64_FORMAT "%s%" G_GINT64_FORMAT "\n",
+                     completion->name, sep, completion->mode, sep, completion->requested_ns,
+                     sep, completion->actual_ns, sep, completion->lateness_ns);
+  }
+
+  return MIN((gsize) len, size - 1);
+}
+
+/**
+ * Writes a whole buffer to fd (one write() unless interrupted).
+ */
+gboolean stream_write(gint fd, const gchar *buf, gsize len)
+{
+  while (len > 0)
+  {
+    gssize n = write(fd, buf, len);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return FALSE;
+    }
+
+    buf += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
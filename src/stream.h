@@ -0,0 +1,67 @@
+/*
+ *  stream.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STREAM_H
+  #define STREAM_H
+
+  #include <glib.h>
+
+  #define STREAM_RECORD_MAX 256 // enough for any record (and the header)
+
+typedef enum
+{
+  STREAM_FORMAT_NONE,
+  STREAM_FORMAT_JSONL,
+  STREAM_FORMAT_CSV,
+  STREAM_FORMAT_TSV
+} stream_format;
+
+/* One progress record. remaining and perc are -1 when they do not apply
+ * (stopwatch). */
+typedef struct
+{
+  const gchar *mode;
+  gint64 elapsed_ns;
+  gint64 remaining_ns;
+  gint perc;
+  gboolean paused;
+} stream_record;
+
+/* The record of a timer of --batch, written when it expires. */
+typedef struct
+{
+  const gchar *name;
+  const gchar *mode;
+  gint64 requested_ns; // its length
+  gint64 actual_ns; // how long it actually took
+  gint64 lateness_ns; // actual_ns - requested_ns
+} stream_completion;
+
+gboolean stream_format_from_string(const gchar *str, stream_format *format);
+gsize stream_format_header(gchar *buf, gsize size, stream_format format);
+gsize stream_format_record(gchar *buf, gsize size, stream_format format, const stream_record *record);
+gsize stream_format_completion_header(gchar *buf, gsize size, stream_format format);
+gsize stream_format_completion(gchar *buf, gsize size, stream_format format, const stream_completion *completion);
+gboolean stream_write(gint fd, const gchar *buf, gsize len);
+
+#endif /* STREAM_H */
@@ -0,0 +1,222 @@
+/*
+ *  table.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "table.h"
+#include "deadline.h"
+
+#define TIMER_TABLE_MIN_CAPACITY 16
+
+/* Grows every array of the table to hold at least capacity slots. */
+static void timer_table_grow(ut_timer_table *table, guint capacity)
+{
+  capacity = MIN(MAX(capacity, TIMER_TABLE_MIN_CAPACITY), TIMER_TABLE_MAX_TIMERS);
+  if (capacity <= table->capacity)
+    return;
+
+  table->deadlines = g_renew(gint64, table->deadlines, capacity);
+  table->next = g_renew(guint32, table->next, capacity);
+  table->prev = g_renew(guint32, table->prev, capacity);
+  table->buckets = g_renew(guint16, table->buckets, capacity);
+  table->states = g_renew(guint8, table->states, capacity);
+  table->generations = g_renew(guint16, table->generations, capacity);
+  table->callbacks = g_renew(guint16, table->callbacks, capacity);
+  table->data = g_renew(gpointer, table->data, capacity);
+  table->capacity = capacity;
+}
+
+/**
+ * Creates a new, empty, timer table with room for capacity timers (it grows
+ * as needed).
+ */
+ut_timer_table* timer_table_new(guint capacity)
+{
+  ut_timer_table *table = g_new0(ut_timer_table, 1);
+
+  timer_table_grow(table, capacity);
+  return table;
+}
+
+void timer_table_free(ut_timer_table *table)
+{
+  if (!table)
+    return;
+
+  g_free(table->deadlines);
+  g_free(table->next);
+  g_free(table->prev);
+  g_free(table->buckets);
+  g_free(table->states);
+  g_free(table->generations);
+  g_free(table->callbacks);
+  g_free(table->data);
+  g_free(table->funcs);
+  g_free(table);
+}
+
+/**
+ * Registers a function to call when a timer expires, with data. Registering
+ * the same function and data again gives the same index.
+ * @return the index of the callback, to give to timer_table_add()
+ */
+guint timer_table_add_callback(ut_timer_table *table, timer_table_func func, gpointer data)
+{
+  guint i;
+
+  g_assert(table && func);
+
+  for (i = 0; i < table->nfuncs; i++)
+    if (table->funcs[i].func == func && table->funcs[i].data == data)
+      return i;
+
+  g_assert(table->nfuncs <= G_MAXUINT16);
+  table->funcs = g_renew(timer_table_callback, table->funcs, table->nfuncs + 1);
+  table->funcs[table->nfuncs].func = func;
+  table->funcs[table->nfuncs].data = data;
+  return table->nfuncs++;
+}
+
+/**
+ * Adds a disarmed timer to the table, reusing a free slot when there is one.
+ * Only its wheel arms it (see wheel_arm()).
+ * @param callback what to call when it expires (see timer_table_add_callback())
+ * @param data kept with the timer (see timer_table_get_data())
+ * @return its handle, or TIMER_HANDLE_NONE if the table is full
+ */
+ut_timer_handle timer_table_add(ut_timer_table *table, guint callback, gpointer data)
+{
+  guint index;
+
+  g_assert(table && callback < table->nfuncs);
+
+  if (table->free_head)
+  {
+    index = table->free_head - 1;
+    table->free_head = table->next[index];
+  }
+  else
+  {
+    if (table->size == TIMER_TABLE_MAX_TIMERS)
+    {
+      g_debug("%s: the table is full", __FUNCTION__);
+      return TIMER_HANDLE_NONE;
+    }
+    if (table->size == table->capacity)
+      timer_table_grow(table, table->capacity * 2);
+
+    index = table->size++;
+    table->generations[index] = 1;
+  }
+
+  table->states[index] = TIMER_STATE_USED;
+  table->deadlines[index] = DEADLINE_NONE;
+  table->next[index] = 0;
+  table->prev[index] = 0;
+  table->callbacks[index] = callback;
+  table->data[index] = data;
+  table->count++;
+
+  return timer_table_handle(table, index);
+}
+
+/**
+ * Returns TRUE if the given handle is a timer of the table: it was handed
+ * out by timer_table_add() and not removed since.
+ */
+gboolean timer_table_is_valid(const ut_timer_table *table, ut_timer_handle handle)
+{
+  guint index = timer_handle_index(handle);
+
+  return table && index < table->size
+         && (table->states[index] & TIMER_STATE_USED)
+         && table->generations[index] == handle >> TIMER_TABLE_INDEX_BITS;
+}
+
+/**
+ * Removes a timer from the table. It must be disarmed (see
+ * wheel_remove_timer()). Its slot goes to the free list, with a new
+ * generation, unless it used them all: then it is retired for good.
+ * @return FALSE if the handle was not valid (e.g. already removed)
+ */
+gboolean timer_table_remove(ut_timer_table *table, ut_timer_handle handle)
+{
+  guint index = timer_handle_index(handle);
+
+  if (!timer_table_is_valid(table, handle))
+    return FALSE;
+
+  g_assert(!(table->states[index] & TIMER_STATE_ARMED));
+  table->states[index] = 0;
+  table->count--;
+
+  // wrapping around would make the stale handles of the slot valid again
+  if (table->generations[index] == TIMER_TABLE_MAX_GENERATION)
+  {
+    g_debug("%s: retiring slot %u", __FUNCTION__, index);
+    return TRUE;
+  }
+
+  table->generations[index]++;
+  table->next[index] = table->free_head;
+  table->free_head = index + 1;
+  return TRUE;
+}
+
+/**
+ * Returns TRUE if the given handle is a valid timer, armed in its wheel.
+ */
+gboolean timer_table_is_armed(const ut_timer_table *table, ut_timer_handle handle)
+{
+  return timer_table_is_valid(table, handle)
+         && (table->states[timer_handle_index(handle)] & TIMER_STATE_ARMED);
+}
+
+/**
+ * Returns the deadline a timer of the table was last armed at, even if it
+ * expired or was disarmed since, or DEADLINE_NONE if it never was armed or
+ * the handle is not valid.
+ */
+gint64 timer_table_get_deadline(const ut_timer_table *table, ut_timer_handle handle)
+{
+  if (!timer_table_is_valid(table, handle))
+    return DEADLINE_NONE;
+
+  return table->deadlines[timer_handle_index(handle)];
+}
+
+/**
+ * Returns the data given with a timer of the table to timer_table_add(), or
+ * NULL if the handle is not valid.
+ */
+gpointer timer_table_get_data(const ut_timer_table *table, ut_timer_handle handle)
+{
+  if (!timer_table_is_valid(table, handle))
+    return NULL;
+
+  return table->data[timer_handle_index(handle)];
+}
@@ -0,0 +1,97 @@
+/*
+ *  table.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TABLE_H
+  #define TABLE_H
+
+  #include <glib.h>
+
+  #define TIMER_TABLE_INDEX_BITS 20 // up to 1M timers
+  #define TIMER_TABLE_MAX_TIMERS (1 << TIMER_TABLE_INDEX_BITS)
+  #define TIMER_TABLE_MAX_GENERATION ((1 << (32 - TIMER_TABLE_INDEX_BITS)) - 1)
+
+  #define TIMER_HANDLE_NONE 0
+  #define timer_handle_index(h) ((h) & (TIMER_TABLE_MAX_TIMERS - 1))
+
+  #define TIMER_STATE_USED  (1 << 0)
+  #define TIMER_STATE_ARMED (1 << 1) // linked in a slot of its wheel
+
+/* Identifies a timer of a ut_timer_table: its slot, and the generation of
+ * the slot when it was handed out. Once the timer is removed the slot is
+ * reused with the next generation, so the old handle is recognized as
+ * stale instead of reaching the new timer. A slot is never reused past
+ * TIMER_TABLE_MAX_GENERATION: a generation never comes back, whatever the
+ * churn. 0 is never a valid handle. */
+typedef guint32 ut_timer_handle;
+
+typedef struct _ut_timer_table ut_timer_table;
+
+typedef void (*timer_table_func)(ut_timer_table *table, ut_timer_handle handle, gpointer data);
+
+typedef struct
+{
+  timer_table_func func;
+  gpointer data;
+} timer_table_callback;
+
+/* The timers of a ut_wheel, stored as a struct of arrays: each field of the
+ * timers has its own contiguous array, indexed by slot. The deadlines are
+ * only ever written by the wheel, which links the armed timers of each of
+ * its slots through next and prev, so running the wheel only reads those
+ * and the deadlines. The callbacks are registered once, and each timer only
+ * keeps the index of its own, next to its own data. */
+struct _ut_timer_table
+{
+  guint size; // slots handed out so far, in use, free or retired
+  guint capacity;
+  guint count; // timers in use
+  guint32 free_head; // first free slot + 1, 0 if none
+  gint64 *deadlines; // the last one each timer was armed at
+  guint32 *next; // next slot + 1 in the same wheel slot or free list, 0 if none
+  guint32 *prev; // previous slot + 1 in the same wheel slot, 0 for the first
+  guint16 *buckets; // wheel slot the timer is linked in (see wheel.c)
+  guint8 *states; // TIMER_STATE_* bits
+  guint16 *generations; // from 1 to TIMER_TABLE_MAX_GENERATION
+  guint16 *callbacks; // index in funcs
+  gpointer *data; // given by the owner of each timer (see timer_table_add())
+  timer_table_callback *funcs;
+  guint nfuncs;
+};
+
+/* Returns the handle of the timer in the given slot of the table. */
+static inline ut_timer_handle timer_table_handle(const ut_timer_table *table, guint index)
+{
+  return ((guint32) table->generations[index] << TIMER_TABLE_INDEX_BITS) | index;
+}
+
+ut_timer_table* timer_table_new(guint capacity);
+void timer_table_free(ut_timer_table *table);
+guint timer_table_add_callback(ut_timer_table *table, timer_table_func func, gpointer data);
+ut_timer_handle timer_table_add(ut_timer_table *table, guint callback, gpointer data);
+gboolean timer_table_remove(ut_timer_table *table, ut_timer_handle handle);
+gboolean timer_table_is_valid(const ut_timer_table *table, ut_timer_handle handle);
+gboolean timer_table_is_armed(const ut_timer_table *table, ut_timer_handle handle);
+gint64 timer_table_get_deadline(const ut_timer_table *table, ut_timer_handle handle);
+gpointer timer_table_get_data(const ut_timer_table *table, ut_timer_handle handle);
+
+#endif /* TABLE_H */
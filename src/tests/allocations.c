@@ -0,0 +1,230 @@
+/*
+ *  tests/allocations.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The allocator functions defined here are found before those of the C
+ * library by the dynamic linker, as they would be from an LD_PRELOAD object,
+ * so the calls made by any library are counted too. Each one forwards to the
+ * next definition, looked up with dlsym(RTLD_NEXT).
+ */
+
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE // RTLD_NEXT
+#endif
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#ifdef HAVE_MALLOC_H
+  #include <malloc.h>
+#endif
+#include <glib.h>
+
+#include "allocations.h"
+
+// serves dlsym() itself while looking up the allocator (glibc calls calloc)
+#define ALLOCATIONS_BOOTSTRAP_SIZE 4096
+#define ALLOCATIONS_BOOTSTRAP_ALIGN 16 // also the size header of each block
+
+static volatile gint allocations_count = 0;
+
+static gboolean allocations_resolving = FALSE;
+static gsize allocations_bootstrap_used = 0;
+static union
+{
+  gchar bytes[ALLOCATIONS_BOOTSTRAP_SIZE];
+  long double align;
+} allocations_bootstrap;
+
+static void *(*real_malloc)(size_t size);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+static void *(*real_realloc)(void *ptr, size_t size);
+static void (*real_free)(void *ptr);
+static int (*real_posix_memalign)(void **memptr, size_t alignment, size_t size);
+#ifdef HAVE_MEMALIGN
+static void *(*real_memalign)(size_t alignment, size_t size);
+#endif
+#ifdef HAVE_ALIGNED_ALLOC
+static void *(*real_aligned_alloc)(size_t alignment, size_t size);
+#endif
+#ifdef HAVE_VALLOC
+static void *(*real_valloc)(size_t size);
+#endif
+#ifdef HAVE_PVALLOC
+static void *(*real_pvalloc)(size_t size);
+#endif
+
+/**
+ * Returns the number of allocations made so far by the whole program.
+ */
+gint allocations_get_count(void)
+{
+  return g_atomic_int_get(&allocations_count);
+}
+
+/* Looks up the next allocator, once (this runs before any thread starts). */
+static void allocations_resolve(void)
+{
+  if (real_free)
+    return;
+
+  allocations_resolving = TRUE;
+  real_malloc = (void *(*)(size_t)) dlsym(RTLD_NEXT, "malloc");
+  real_calloc = (void *(*)(size_t, size_t)) dlsym(RTLD_NEXT, "calloc");
+  real_realloc = (void *(*)(void *, size_t)) dlsym(RTLD_NEXT, "realloc");
+  real_posix_memalign = (int (*)(void **, size_t, size_t)) dlsym(RTLD_NEXT, "posix_memalign");
+#ifdef HAVE_MEMALIGN
+  real_memalign = (void *(*)(size_t, size_t)) dlsym(RTLD_NEXT, "memalign");
+#endif
+#ifdef HAVE_ALIGNED_ALLOC
+  real_aligned_alloc = (void *(*)(size_t, size_t)) dlsym(RTLD_NEXT, "aligned_alloc");
+#endif
+#ifdef HAVE_VALLOC
+  real_valloc = (void *(*)(size_t)) dlsym(RTLD_NEXT, "valloc");
+#endif
+#ifdef HAVE_PVALLOC
+  real_pvalloc = (void *(*)(size_t)) dlsym(RTLD_NEXT, "pvalloc");
+#endif
+  real_free = (void (*)(void *)) dlsym(RTLD_NEXT, "free");
+  allocations_resolving = FALSE;
+
+  if (!real_malloc || !real_calloc || !real_realloc || !real_free || !real_posix_memalign)
+    abort();
+}
+
+/* Allocates zeroed memory from the bootstrap buffer, never freed. */
+static void *allocations_bootstrap_alloc(size_t size)
+{
+  gchar *block = allocations_bootstrap.bytes + allocations_bootstrap_used;
+  gsize needed = ALLOCATIONS_BOOTSTRAP_ALIGN
+                 + (size + ALLOCATIONS_BOOTSTRAP_ALIGN - 1) / ALLOCATIONS_BOOTSTRAP_ALIGN
+                   * ALLOCATIONS_BOOTSTRAP_ALIGN;
+
+  if (needed > ALLOCATIONS_BOOTSTRAP_SIZE - allocations_bootstrap_used)
+    return NULL;
+
+  allocations_bootstrap_used += needed;
+  *(gsize *) block = size;
+  return block + ALLOCATIONS_BOOTSTRAP_ALIGN;
+}
+
+static gboolean allocations_is_bootstrap(void *ptr)
+{
+  return (gchar *) ptr >= allocations_bootstrap.bytes
+         && (gchar *) ptr < allocations_bootstrap.bytes + ALLOCATIONS_BOOTSTRAP_SIZE;
+}
+
+void *malloc(size_t size)
+{
+  if (allocations_resolving)
+    return allocations_bootstrap_alloc(size);
+
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  if (allocations_resolving)
+    return (size && nmemb > G_MAXSIZE / size) ? NULL : allocations_bootstrap_alloc(nmemb * size);
+
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  void *moved;
+
+  if (allocations_resolving)
+    return NULL;
+
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  if (!allocations_is_bootstrap(ptr))
+    return real_realloc(ptr, size);
+
+  // out of the bootstrap buffer, which cannot grow in place
+  moved = real_malloc(size);
+  if (moved)
+    memcpy(moved, ptr, MIN(size, *(gsize *) ((gchar *) ptr - ALLOCATIONS_BOOTSTRAP_ALIGN)));
+  return moved;
+}
+
+void free(void *ptr)
+{
+  if (!ptr || allocations_is_bootstrap(ptr))
+    return;
+
+  allocations_resolve();
+  real_free(ptr);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_posix_memalign(memptr, alignment, size);
+}
+
+#ifdef HAVE_MEMALIGN
+void *memalign(size_t alignment, size_t size)
+{
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_memalign(alignment, size);
+}
+#endif
+
+#ifdef HAVE_ALIGNED_ALLOC
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_aligned_alloc(alignment, size);
+}
+#endif
+
+#ifdef HAVE_VALLOC
+void *valloc(size_t size)
+{
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_valloc(size);
+}
+#endif
+
+#ifdef HAVE_PVALLOC
+void *pvalloc(size_t size)
+{
+  allocations_resolve();
+  g_atomic_int_inc(&allocations_count);
+  return real_pvalloc(size);
+}
+#endif
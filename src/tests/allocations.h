@@ -0,0 +1,38 @@
+/*
+ *  tests/allocations.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ALLOCATIONS_H
+  #define ALLOCATIONS_H
+
+  #include <glib.h>
+
+/*
+ * Allocation counter of the tests: allocations.c interposes the allocator
+ * of the C library for the whole program (GLib included). It is only built
+ * when configure finds dlsym() and RTLD_NEXT, which then defines
+ * TEST_COUNT_ALLOCATIONS for maintests.
+ */
+
+gint allocations_get_count(void);
+
+#endif /* ALLOCATIONS_H */
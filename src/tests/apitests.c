@@ -0,0 +1,198 @@
+/*
+ *  tests/apitests.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * apitests: libutimer as a program embedding it sees it. Only libutimer.h
+ * is included, and only the installed library (libutimer.la) is linked, so
+ * a function missing from libutimer.sym fails the build.
+ */
+
+#include <glib.h>
+#include <libutimer.h>
+
+#define API_TIMEOUT_MSEC 5000 // fails a test waiting for a timer that never ends
+
+typedef struct
+{
+  GMainLoop *loop;
+  guint succeeded;
+  guint failed;
+} api_state;
+
+static void api_timer_succeeded(ut_timer *t, gpointer data)
+{
+  api_state *state = data;
+
+  state->succeeded++;
+  g_main_loop_quit(state->loop);
+}
+
+static void api_timer_failed(ut_timer *t, gpointer data)
+{
+  api_state *state = data;
+
+  state->failed++;
+  g_main_loop_quit(state->loop);
+}
+
+static gboolean api_timeout(api_state *state)
+{
+  g_main_loop_quit(state->loop);
+  return FALSE;
+}
+
+/* Runs the main loop of state until a timer ends, or the timeout. */
+static void api_run(api_state *state, GMainContext *main_context)
+{
+  GSource *timeout = g_timeout_source_new(API_TIMEOUT_MSEC);
+
+  g_source_set_callback(timeout, (GSourceFunc) api_timeout, state, NULL);
+  g_source_attach(timeout, main_context);
+  g_main_loop_run(state->loop);
+  g_source_destroy(timeout);
+  g_source_unref(timeout);
+}
+
+/**
+ * Runs a countdown on a main context of its own, from ut_timer_start() to
+ * the success callback
+ */
+static void test_api_countdown()
+{
+  const ut_duration length = 50 * UT_NSEC_PER_MSEC;
+  GMainContext *main_context = g_main_context_new();
+  ut_context *ctx = ut_context_new(main_context);
+  ut_clock *clock = ut_clock_new();
+  api_state state = { g_main_loop_new(main_context, FALSE), 0, 0 };
+  ut_timer *t;
+
+  g_assert(ut_context_get_main_context(ctx) == main_context);
+  ut_context_set_quiet(ctx, TRUE);
+
+  t = ut_timer_new_countdown(length, api_timer_succeeded, api_timer_failed, &state,
+                             ctx, clock, TIMER_PRECISION_DEFAULT, NULL);
+  g_assert(t);
+  ut_timer_start(t);
+  g_assert(!ut_timer_has_expired(t));
+  g_assert_cmpint(ut_timer_get_remaining(t), >, 0);
+
+  api_run(&state, main_context);
+  g_assert_cmpuint(state.succeeded, ==, 1);
+  g_assert_cmpuint(state.failed, ==, 0);
+  g_assert(ut_timer_has_expired(t));
+  g_assert_cmpint(ut_timer_get_elapsed(t), >=, length);
+  g_assert_cmpint(ut_timer_get_remaining(t), ==, 0);
+  g_assert_cmpint(ut_timer_get_progress_percent(t), ==, 100);
+
+  ut_timer_destroy(t);
+  ut_clock_destroy(clock);
+  ut_context_free(ctx);
+  g_main_loop_unref(state.loop);
+  g_main_context_unref(main_context);
+}
+
+/**
+ * Pauses and resumes a timer: its time stops while paused, and it still
+ * expires once resumed
+ */
+static void test_api_pause()
+{
+  const ut_duration length = 50 * UT_NSEC_PER_MSEC;
+  ut_context *ctx = ut_context_new(NULL);
+  ut_clock *clock = ut_clock_new();
+  api_state state = { g_main_loop_new(NULL, FALSE), 0, 0 };
+  ut_duration elapsed;
+  ut_timer *t;
+
+  t = ut_timer_new_timer(length, api_timer_succeeded, api_timer_failed, &state,
+                         ctx, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_timer_start(t);
+  ut_timer_pause(t);
+  g_assert(ut_timer_is_paused(t));
+
+  elapsed = ut_timer_get_elapsed(t);
+  g_usleep(2 * length / UT_NSEC_PER_USEC);
+  g_assert_cmpint(ut_timer_get_elapsed(t), ==, elapsed);
+  g_assert(!ut_timer_has_expired(t));
+
+  ut_timer_resume(t);
+  g_assert(!ut_timer_is_paused(t));
+  api_run(&state, NULL);
+  g_assert_cmpuint(state.succeeded, ==, 1);
+  g_assert(ut_timer_has_expired(t));
+
+  ut_timer_destroy(t);
+  ut_clock_destroy(clock);
+  ut_context_free(ctx);
+  g_main_loop_unref(state.loop);
+}
+
+/**
+ * Starts a stopwatch again: it counts from 0 each time, and never expires
+ */
+static void test_api_restart()
+{
+  ut_context *ctx = ut_context_new(NULL);
+  ut_clock *clock = ut_clock_new();
+  ut_timer *t;
+
+  t = ut_timer_new_stopwatch(NULL, NULL, NULL, ctx, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_timer_start(t);
+  g_usleep(20000);
+  g_assert_cmpint(ut_timer_get_elapsed(t), >=, 20 * UT_NSEC_PER_MSEC);
+
+  ut_timer_start(t);
+  g_assert_cmpint(ut_timer_get_elapsed(t), <, 20 * UT_NSEC_PER_MSEC);
+  g_assert(!ut_timer_has_expired(t));
+
+  ut_timer_destroy(t);
+  ut_clock_destroy(clock);
+  ut_context_free(ctx);
+}
+
+/**
+ * Reads time patterns as the command-line program does
+ */
+static void test_api_parse()
+{
+  gchar minutes[] = "1m30s", milliseconds[] = "250ms";
+  ut_duration d = 0;
+
+  // (an invalid pattern is reported with g_warning(), fatal in a test)
+  g_assert(ut_parse_time_pattern(minutes, &d));
+  g_assert_cmpint(d, ==, 90 * UT_NSEC_PER_SEC);
+  g_assert(ut_parse_time_pattern(milliseconds, &d));
+  g_assert_cmpint(d, ==, 250 * UT_NSEC_PER_MSEC);
+}
+
+gint main(gint argc, gchar *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/API/Countdown", test_api_countdown);
+  g_test_add_func("/API/Pause", test_api_pause);
+  g_test_add_func("/API/Restart", test_api_restart);
+  g_test_add_func("/API/Parse", test_api_parse);
+
+  return g_test_run();
+}
@@ -25,16 +25,27 @@
   #include <config.h>
 #endif
 
+#include <pthread.h>
 #include <signal.h>
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/utsname.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 #include <glib-object.h>
 
+#include "../deadline.h"
+#include "../signals.h"
+#include "../table.h"
+#include "../batch.h"
 #include "../timer.h"
+#include "../log.h"
+#ifdef TEST_COUNT_ALLOCATIONS
+  #include "allocations.h"
+#endif
 
 #ifdef G_DISABLE_ASSERT
   #undef G_DISABLE_ASSERT
@@ -42,9 +53,19 @@
 
 
 #define TEST_DURATION_MAX_OFFSET_MSECONDS 100
+#define TEST_PRECISE_MAX_OVERSHOOT_USECONDS 1000
+#define TEST_ACCURACY_RUNS 240 // timers per expiry strategy
+#define TEST_ACCURACY_CSV "expiry-accuracy.csv" // raw samples, in the current directory
+// p99 bounds leave room for preemption on a loaded (or single CPU) machine
+#define TEST_ACCURACY_SLEEP_P50_USECONDS 1000
+#define TEST_ACCURACY_SLEEP_P99_USECONDS 10000
+#define TEST_ACCURACY_SPIN_P50_USECONDS 50
+#define TEST_ACCURACY_SPIN_P99_USECONDS 5000
+
+static GMainLoop *loop;
+static Config ut_config;
+static ut_context *test_context;
 
-GMainLoop *loop;
-Config ut_config;
 
 static void quitloop(int error_status)
 {
@@ -66,33 +87,83 @@ static void success_quitloop()
   quitloop(EXIT_SUCCESS);
 }
 
+static void test_timer_succeeded(ut_timer *t, gpointer data)
+{
+  success_quitloop();
+}
+
+static void test_timer_failed(ut_timer *t, gpointer data)
+{
+  error_quitloop();
+}
+
+static void test_batch_done(ut_batch *b, gpointer data)
+{
+  success_quitloop();
+}
+
+/**
+ * Returns the timing wheel of test_context on the given clock source, or
+ * NULL when no timer waits on it.
+ */
+static ut_wheel* test_context_wheel(ut_clock_source *source)
+{
+  GSList *l;
+
+  for (l = test_context->wheels; l; l = l->next)
+    if (((ut_wheel *) l->data)->clock == source)
+      return l->data;
+
+  return NULL;
+}
+
+static void test_free_virtual_clock(ut_clock *clock)
+{
+  ut_clock_source_free(clock->source);
+  ut_clock_destroy(clock);
+}
+
+/**
+ * Returns a started clock on a new virtual clock source (freed with the test).
+ * Time only passes on it with ut_clock_source_advance(), or when the main
+ * loop waits for a deadline, so the tests using it neither sleep nor depend
+ * on the load of the machine.
+ */
+static ut_clock* test_clock_new_virtual()
+{
+  ut_clock *clock = ut_clock_new_with_source(ut_clock_source_new_virtual());
+
+  g_test_queue_destroy((GDestroyNotify) test_free_virtual_clock, clock);
+  return clock;
+}
+
 /**
- * Runs the timer for the given duration
+ * Runs the timer for the given duration, on a virtual clock
  * There is a timeout that prevents the function from running endlessly
  * Errors are thrown using asserts
  */
 static void timer_duration_launcher(guint seconds, guint mseconds, guint max_mseconds_offset)
 {
-  GTimer *globaltimer = g_timer_new();
-  guint timeout = seconds * 1000 + mseconds + max_mseconds_offset + 500;
+  ut_clock *globalclock = test_clock_new_virtual();
+  ut_duration length = seconds * UT_NSEC_PER_SEC + mseconds * UT_NSEC_PER_MSEC;
+  guint timeout = max_mseconds_offset + 500;
   g_assert(!loop);
   g_test_timer_start();
-  g_test_queue_free(globaltimer);
 
-  ut_timer *ttimer = timer_new_timer(seconds,
-                                     mseconds,
-                                     success_quitloop,
-                                     error_quitloop,
-                                     globaltimer,
-                                     TIMER_PRECISION_DEFAULT,
-                                     NULL);
-  g_test_queue_free(ttimer);
+  ut_timer *ttimer = ut_timer_new_timer(length,
+                                        test_timer_succeeded,
+                                        test_timer_failed,
+                                        NULL,
+                                        test_context,
+                                        globalclock,
+                                        TIMER_PRECISION_DEFAULT,
+                                        NULL);
 
   loop = g_main_loop_new(NULL, FALSE);
 
-  g_debug("Starting Timer thread");
+  g_debug("Starting Timer expiry");
 
-  g_assert(g_thread_create((GThreadFunc) timer_check_loop, ttimer, FALSE, NULL));
+  ut_timer_start(ttimer);
 
   g_debug("%s: timeout is %u ms", __FUNCTION__, timeout);
   guint timeout_id = g_timeout_add(timeout, (GSourceFunc) error_quitloop, NULL);
@@ -103,20 +174,16 @@ static void timer_duration_launcher(guint seconds, guint mseconds, guint max_mse
   loop = NULL;
 
   g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert(ttimer->wheel == NULL);
 
-  gdouble elapsed = g_test_timer_elapsed();
-  gdouble maxelapsed = (gdouble) seconds + (gdouble) (mseconds + max_mseconds_offset) / 1000;
-
-  gdouble minelapsed = 0;
-  if (seconds != 0 || mseconds > max_mseconds_offset)
-    minelapsed = (gdouble) seconds + (gdouble) mseconds / 1000 - (gdouble) max_mseconds_offset / 1000;
+  // expired right on time, without actually waiting
+  g_assert_cmpint(ut_clock_elapsed(globalclock), ==, length);
+  g_assert_cmpint(ttimer->overshoot, ==, 0);
+  ut_timer_destroy(ttimer);
 
+  gdouble elapsed = g_test_timer_elapsed();
   g_debug("elapsed: %f", elapsed);
-  g_debug("maxelapsed: %f", maxelapsed);
-  g_debug("minelapsed: %f", minelapsed);
-
-  g_assert_cmpfloat(minelapsed, <=, elapsed);
-  g_assert_cmpfloat(elapsed, <=, maxelapsed);
+  g_assert_cmpfloat(elapsed, <=, (gdouble) max_mseconds_offset / 1000);
 }
 
 /**
@@ -131,13 +198,319 @@ static void test_timer_duration1(void)
   timer_duration_launcher(0, 50, TEST_DURATION_MAX_OFFSET_MSECONDS);
   timer_duration_launcher(0, 100, TEST_DURATION_MAX_OFFSET_MSECONDS);
   timer_duration_launcher(0, 200, TEST_DURATION_MAX_OFFSET_MSECONDS);
+  timer_duration_launcher(1, 150, TEST_DURATION_MAX_OFFSET_MSECONDS);
+  timer_duration_launcher(2, 99, TEST_DURATION_MAX_OFFSET_MSECONDS);
+  timer_duration_launcher(86400, 1, TEST_DURATION_MAX_OFFSET_MSECONDS);
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests that the time spent paused does not count, on a virtual clock
+ */
+static void test_timer_pause()
+{
+  g_debug("START: %s", __FUNCTION__);
+  ut_clock *clock = test_clock_new_virtual();
+  g_assert(!loop);
+
+  ut_timer *ttimer = ut_timer_new_countdown(2 * UT_NSEC_PER_SEC,
+                                            test_timer_succeeded,
+                                            test_timer_failed,
+                                            NULL,
+                                            test_context,
+                                            clock,
+                                            TIMER_PRECISION_DEFAULT,
+                                            NULL);
+
+  loop = g_main_loop_new(NULL, FALSE);
+  timer_enable_stats(ttimer);
+  ut_timer_start(ttimer);
+
+  ut_clock_source_advance(clock->source, 500 * UT_NSEC_PER_MSEC);
+  ut_timer_pause(ttimer);
+  g_assert(ut_timer_is_paused(ttimer));
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_SEC);
+  g_assert_cmpint(ut_clock_elapsed(clock), ==, 500 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ut_timer_get_elapsed(ttimer), ==, 500 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ut_timer_get_remaining(ttimer), ==, 1500 * UT_NSEC_PER_MSEC);
+  g_assert(!ut_timer_has_expired(ttimer));
+  ut_timer_resume(ttimer);
+  g_assert(!ut_timer_is_paused(ttimer));
+
+  guint timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert_cmpint(ut_clock_elapsed(clock), ==, 2 * UT_NSEC_PER_SEC);
+  g_assert_cmpint(ut_clock_source_now(clock->source), ==, 12 * UT_NSEC_PER_SEC);
+  g_assert_cmpint(ttimer->overshoot, ==, 0);
+  g_assert(ut_timer_has_expired(ttimer));
+  g_assert_cmpint(ut_timer_get_remaining(ttimer), ==, 0);
+
+  // woke up once, on time
+  g_assert_cmpuint(ttimer->stats->wakeups, ==, 1);
+  g_assert_cmpint(ttimer->stats->lateness.max, ==, 0);
+
+  ut_timer_destroy(ttimer);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests that a timer counts from ut_timer_start(), not from the creation of
+ * its clock, and that starting it again restarts it, on a virtual clock
+ */
+static void test_timer_start()
+{
+  g_debug("START: %s", __FUNCTION__);
+  ut_clock *clock = test_clock_new_virtual();
+  g_assert(!loop);
+
+  ut_timer *ttimer = ut_timer_new_timer(UT_NSEC_PER_SEC,
+                                        test_timer_succeeded,
+                                        test_timer_failed,
+                                        NULL,
+                                        test_context,
+                                        clock,
+                                        TIMER_PRECISION_DEFAULT,
+                                        NULL);
+
+  loop = g_main_loop_new(NULL, FALSE);
+
+  // the clock counts from its creation, the timer from its start
+  ut_clock_source_advance(clock->source, 3 * UT_NSEC_PER_SEC);
+  ut_timer_start(ttimer);
+  g_assert_cmpint(ut_timer_get_elapsed(ttimer), ==, 0);
+
+  ut_clock_source_advance(clock->source, 600 * UT_NSEC_PER_MSEC);
+  ut_timer_start(ttimer);
+  g_assert_cmpint(ut_timer_get_remaining(ttimer), ==, UT_NSEC_PER_SEC);
+
+  guint timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert_cmpint(ut_clock_source_now(clock->source), ==, 4600 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ttimer->overshoot, ==, 0);
+  g_assert(ut_timer_has_expired(ttimer));
+
+  ut_timer_destroy(ttimer);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests that a countdown on CLOCK_BOOTTIME (--clock=boottime) expires on
+ * time, woken up by a CLOCK_BOOTTIME timerfd
+ */
+static void test_timer_boottime()
+{
+  g_debug("START: %s", __FUNCTION__);
+  ut_clock_source *source = ut_clock_source_new(UT_CLOCK_SOURCE_BOOTTIME);
+  g_assert(!loop);
+
+  if (source->type != UT_CLOCK_SOURCE_BOOTTIME)
+  {
+    g_test_message("no CLOCK_BOOTTIME on this machine, skipped");
+    ut_clock_source_free(source);
+    return;
+  }
+
+  ut_clock *clock = ut_clock_new_with_source(source);
+  ut_timer *ttimer = ut_timer_new_countdown(20 * UT_NSEC_PER_MSEC,
+                                            test_timer_succeeded,
+                                            test_timer_failed,
+                                            NULL,
+                                            test_context,
+                                            clock,
+                                            TIMER_PRECISION_DEFAULT,
+                                            NULL);
+
+  loop = g_main_loop_new(NULL, FALSE);
+  timer_enable_stats(ttimer);
+  ut_timer_start(ttimer);
+  guint timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
+
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert_cmpint(ttimer->overshoot, >=, 0);
+  g_assert_cmpint(ttimer->overshoot, <, TEST_DURATION_MAX_OFFSET_MSECONDS * UT_NSEC_PER_MSEC);
+  g_assert_cmpuint(ttimer->stats->wakeups, ==, 1);
+
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
+  ut_clock_source_free(source);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests that a spinning timer (see timer_set_spin()) expires right on time
+ */
+static void test_timer_precise(void)
+{
+  g_debug("START: %s", __FUNCTION__);
+  ut_clock *clock = ut_clock_new();
+  g_test_queue_free(clock);
+  g_assert(!loop);
+
+  ut_timer *ttimer = ut_timer_new_timer(50 * UT_NSEC_PER_MSEC,
+                                        test_timer_succeeded,
+                                        test_timer_failed,
+                                        NULL,
+                                        test_context,
+                                        clock,
+                                        TIMER_PRECISION_DEFAULT,
+                                        NULL);
+  g_assert_cmpint(ttimer->overshoot, ==, -1);
+
+  loop = g_main_loop_new(NULL, FALSE);
+  timer_enable_stats(ttimer);
+  timer_set_spin(ttimer, 5 * UT_NSEC_PER_MSEC);
+  ut_timer_start(ttimer);
+  guint timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
+
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_debug("%s: overshoot: %" G_GINT64_FORMAT " ns", __FUNCTION__, ttimer->overshoot);
+  g_assert_cmpint(ttimer->overshoot, >=, 0);
+  g_assert_cmpint(ttimer->overshoot, <, TEST_PRECISE_MAX_OVERSHOOT_USECONDS * UT_NSEC_PER_USEC);
+
+  // one wake-up of the expiry source, 5 ms before the end
+  g_assert_cmpuint(ttimer->stats->wakeups, ==, 1);
+  g_assert_cmpuint(ttimer->stats->lateness.count, ==, 1);
+  g_assert_cmpint(ttimer->stats->lateness.max, <, 5 * UT_NSEC_PER_MSEC);
+
+  ut_timer_destroy(ttimer);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Runs one timer (or countdown) of the given length with the given spin
+ * margin (see timer_set_spin()), and returns how late it expired.
+ */
+static ut_duration test_run_expiry(timer_mode mode, ut_duration length, ut_duration spin)
+{
+  ut_clock *clock = ut_clock_new();
+  ut_timer *ttimer;
+  ut_duration overshoot;
+  guint timeout_id;
+
+  g_assert(!loop);
+
+  if (mode == TIMER_MODE_COUNTDOWN)
+    ttimer = ut_timer_new_countdown(length, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  else
+    ttimer = ut_timer_new_timer(length, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+
+  loop = g_main_loop_new(NULL, FALSE);
+  timer_set_spin(ttimer, spin);
+  ut_timer_start(ttimer);
+  timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
+
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  overshoot = ttimer->overshoot;
+  g_assert_cmpint(overshoot, >=, 0);
 
-  if (!g_test_quick())
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
+  return overshoot;
+}
+
+/**
+ * Runs TEST_ACCURACY_RUNS short timers and countdowns with an expiry
+ * strategy, asserts on the percentiles of how late they expired, and
+ * appends the samples to TEST_ACCURACY_CSV (to compare kernels and hosts).
+ */
+static void test_accuracy_launcher(const gchar *strategy, ut_duration spin,
+                                   ut_duration max_p50, ut_duration max_p99)
+{
+  const ut_duration lengths[] = { 1 * UT_NSEC_PER_MSEC, 2 * UT_NSEC_PER_MSEC,
+                                  3 * UT_NSEC_PER_MSEC, 5 * UT_NSEC_PER_MSEC,
+                                  8 * UT_NSEC_PER_MSEC, 13 * UT_NSEC_PER_MSEC };
+  stats_histogram *h = g_new(stats_histogram, 1);
+  struct utsname host;
+  ut_duration p50, p99;
+  FILE *csv;
+  guint i;
+
+  if (uname(&host) < 0)
+    g_strlcpy(host.release, "unknown", sizeof(host.release));
+
+  csv = fopen(TEST_ACCURACY_CSV, "a");
+  if (!csv)
+    g_test_message("cannot write %s, the samples are not saved", TEST_ACCURACY_CSV);
+  else if (ftell(csv) == 0)
+    fprintf(csv, "kernel,strategy,mode,length_ns,overshoot_ns\n");
+
+  stats_histogram_init(h);
+
+  for (i = 0; i < TEST_ACCURACY_RUNS; i++)
   {
-    timer_duration_launcher(1, 150, TEST_DURATION_MAX_OFFSET_MSECONDS);
-    timer_duration_launcher(2, 99, TEST_DURATION_MAX_OFFSET_MSECONDS);
+    timer_mode mode = (i % 2 ? TIMER_MODE_COUNTDOWN : TIMER_MODE_TIMER);
+    ut_duration length = lengths[(i / 2) % G_N_ELEMENTS(lengths)];
+    ut_duration overshoot = test_run_expiry(mode, length, spin);
+
+    stats_histogram_record(h, overshoot);
+    if (csv)
+      fprintf(csv, "%s,%s,%s,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT "\n",
+              host.release, strategy,
+              mode == TIMER_MODE_COUNTDOWN ? "countdown" : "timer",
+              length, overshoot);
   }
 
+  if (csv)
+    fclose(csv);
+
+  p50 = stats_histogram_percentile(h, 50);
+  p99 = stats_histogram_percentile(h, 99);
+  g_test_message("%s: p50 %" G_GINT64_FORMAT " ns, p99 %" G_GINT64_FORMAT
+                 " ns, max %" G_GINT64_FORMAT " ns (%u timers)",
+                 strategy, p50, p99, h->max, TEST_ACCURACY_RUNS);
+
+  g_assert_cmpint(p50, <=, max_p50);
+  g_assert_cmpint(p99, <=, max_p99);
+  g_free(h);
+}
+
+/**
+ * Expiry accuracy of the default strategy: sleeping until the end
+ */
+static void test_accuracy_sleep(void)
+{
+  g_debug("START: %s", __FUNCTION__);
+  test_accuracy_launcher("sleep", 0,
+                         TEST_ACCURACY_SLEEP_P50_USECONDS * UT_NSEC_PER_USEC,
+                         TEST_ACCURACY_SLEEP_P99_USECONDS * UT_NSEC_PER_USEC);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Expiry accuracy of --precise: sleeping, then spinning for the last 200 us
+ */
+static void test_accuracy_spin(void)
+{
+  g_debug("START: %s", __FUNCTION__);
+  test_accuracy_launcher("spin", TIMER_DEFAULT_SPIN_USEC * UT_NSEC_PER_USEC,
+                         TEST_ACCURACY_SPIN_P50_USECONDS * UT_NSEC_PER_USEC,
+                         TEST_ACCURACY_SPIN_P99_USECONDS * UT_NSEC_PER_USEC);
   g_debug("END: %s", __FUNCTION__);
 }
 
@@ -157,15 +530,15 @@ static void test_suffix1(void)
 
   for (i = 0; i < count; i++)
   {
-    guint n = g_test_rand_int();
-    guint days = n,
-            hours = n,
-            minutes = n,
-            seconds = n,
-            seconds2 = n,
-            seconds3 = n,
-            dummy1 = n,
-            overflow1 = G_MAXUINT - 195; /* forcing an overflow, see below */
+    ut_duration n = (guint) g_test_rand_int();
+    ut_duration days = n,
+                hours = n,
+                minutes = n,
+                seconds = n,
+                seconds2 = n,
+                seconds3 = n,
+                dummy1 = n,
+                overflow1 = UT_DURATION_MAX - 195; /* forcing an overflow, see below */
 
     /* they should all return TRUE */
     g_assert(apply_suffix(&days, "d"));
@@ -178,16 +551,16 @@ static void test_suffix1(void)
     /* this should return FALSE as 'x' is unknown */
     g_assert(!apply_suffix(&dummy1, "x"));
 
-    /* This overflows so overflow1 should be MAXUINT */
+    /* This overflows so overflow1 should be UT_DURATION_MAX */
     g_assert(apply_suffix(&overflow1, "d"));
-    g_assert_cmpint(overflow1, ==, G_MAXUINT);
-
-    g_assert(days == n * 86400 || days == G_MAXUINT);
-    g_assert(hours == n * 3600 || hours == G_MAXUINT);
-    g_assert(minutes == n * 60 || minutes == G_MAXUINT);
-    g_assert_cmpint(seconds, ==, n);
-    g_assert_cmpint(seconds2, ==, n);
-    g_assert_cmpint(seconds3, ==, n);
+    g_assert_cmpint(overflow1, ==, UT_DURATION_MAX);
+
+    g_assert(days / (86400 * UT_NSEC_PER_SEC) == n || days == UT_DURATION_MAX);
+    g_assert(hours / (3600 * UT_NSEC_PER_SEC) == n || hours == UT_DURATION_MAX);
+    g_assert(minutes / (60 * UT_NSEC_PER_SEC) == n || minutes == UT_DURATION_MAX);
+    g_assert_cmpint(seconds, ==, n * UT_NSEC_PER_SEC);
+    g_assert_cmpint(seconds2, ==, n * UT_NSEC_PER_SEC);
+    g_assert_cmpint(seconds3, ==, n * UT_NSEC_PER_SEC);
     g_assert_cmpint(dummy1, ==, n);
   }
 
@@ -200,23 +573,23 @@ static void test_suffix1(void)
 static void test_creation_timer()
 {
   g_debug("START: %s", __FUNCTION__);
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
-  guint sec = g_test_rand_int();
-  guint msec = g_test_rand_int();
+  ut_clock *clock = ut_clock_new();
+  ut_duration length = (guint) g_test_rand_int() * UT_NSEC_PER_SEC
+                       + (guint) g_test_rand_int() * UT_NSEC_PER_MSEC;
 
-  ut_timer *ttimer = timer_new_timer(sec, msec, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_MILLISECOND, NULL);
+  ut_timer *ttimer = ut_timer_new_timer(length, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, NULL);
   g_assert(ttimer);
-  g_test_queue_free(ttimer);
 
-  g_assert_cmpuint(ttimer->seconds, ==, ui_add(sec, msec / 1000));
-  g_assert_cmpuint(ttimer->mseconds, ==, msec % 1000);
-  g_assert(ttimer->gtimer == gtimer);
-  g_assert(ttimer->success_callback == success_quitloop);
-  g_assert(ttimer->error_callback == error_quitloop);
+  g_assert_cmpint(ttimer->length, ==, length);
+  g_assert(ttimer->clock == clock);
+  g_assert(ttimer->success_callback == test_timer_succeeded);
+  g_assert(ttimer->error_callback == test_timer_failed);
   g_assert_cmpuint(ttimer->mode, ==, TIMER_MODE_TIMER);
-  g_assert(ttimer->checkloop_thread_stop_with_error == FALSE);
+  g_assert(ttimer->wheel == NULL);
   g_assert(ttimer->precision == TIMER_PRECISION_MILLISECOND);
+
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
   g_debug("END: %s", __FUNCTION__);
 }
 
@@ -226,21 +599,21 @@ static void test_creation_timer()
 static void test_creation_stopwatch()
 {
   g_debug("START: %s", __FUNCTION__);
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  ut_clock *clock = ut_clock_new();
 
-  ut_timer *ttimer = timer_new_stopwatch(success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_SECOND, NULL);
+  ut_timer *ttimer = ut_timer_new_stopwatch(test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_SECOND, NULL);
   g_assert(ttimer);
-  g_test_queue_free(ttimer);
 
-  g_assert_cmpuint(ttimer->seconds, ==, 0);
-  g_assert_cmpuint(ttimer->mseconds, ==, 0);
-  g_assert(ttimer->gtimer == gtimer);
-  g_assert(ttimer->success_callback == success_quitloop);
-  g_assert(ttimer->error_callback == error_quitloop);
+  g_assert_cmpint(ttimer->length, ==, 0);
+  g_assert(ttimer->clock == clock);
+  g_assert(ttimer->success_callback == test_timer_succeeded);
+  g_assert(ttimer->error_callback == test_timer_failed);
   g_assert_cmpuint(ttimer->mode, ==, TIMER_MODE_STOPWATCH);
-  g_assert(ttimer->checkloop_thread_stop_with_error == FALSE);
+  g_assert(ttimer->wheel == NULL);
   g_assert(ttimer->precision == TIMER_PRECISION_SECOND);
+
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
   g_debug("END: %s", __FUNCTION__);
 }
 
@@ -250,279 +623,740 @@ static void test_creation_stopwatch()
 static void test_creation_countdown()
 {
   g_debug("START: %s", __FUNCTION__);
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
-  guint sec = g_test_rand_int();
-  guint msec = g_test_rand_int();
+  ut_clock *clock = ut_clock_new();
+  ut_duration length = (guint) g_test_rand_int() * UT_NSEC_PER_SEC
+                       + (guint) g_test_rand_int() * UT_NSEC_PER_MSEC;
 
-  ut_timer *ttimer = timer_new_countdown(sec, msec, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_MINUTE, NULL);
+  ut_timer *ttimer = ut_timer_new_countdown(length, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MINUTE, NULL);
   g_assert(ttimer);
-  g_test_queue_free(ttimer);
 
-  g_assert_cmpuint(ttimer->seconds, ==, ui_add(sec, msec / 1000));
-  g_assert_cmpuint(ttimer->mseconds, ==, msec % 1000);
-  g_assert(ttimer->gtimer == gtimer);
-  g_assert(ttimer->success_callback == success_quitloop);
-  g_assert(ttimer->error_callback == error_quitloop);
+  g_assert_cmpint(ttimer->length, ==, length);
+  g_assert(ttimer->clock == clock);
+  g_assert(ttimer->success_callback == test_timer_succeeded);
+  g_assert(ttimer->error_callback == test_timer_failed);
   g_assert_cmpuint(ttimer->mode, ==, TIMER_MODE_COUNTDOWN);
-  g_assert(ttimer->checkloop_thread_stop_with_error == FALSE);
+  g_assert(ttimer->wheel == NULL);
   g_assert(ttimer->precision == TIMER_PRECISION_MINUTE);
+
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
   g_debug("END: %s", __FUNCTION__);
 }
 
 /**
- * Basic tests for timer_sec_msec_to_string
+ * Basic tests for timer_duration_to_string
  */
-static void test_timer_sec_msec_to_string()
+static void test_timer_duration_to_string()
 {
   g_debug("START: %s", __FUNCTION__);
   gchar* tmp;
 
-  tmp = timer_sec_msec_to_string(0, 0, TIMER_PRECISION_MILLISECOND);
+  tmp = timer_duration_to_string(0, TIMER_PRECISION_MILLISECOND);
   g_assert(tmp);
   g_test_queue_free(tmp);
 
-  tmp = timer_sec_msec_to_string(1000000, 0, TIMER_PRECISION_HOUR);
+  tmp = timer_duration_to_string(1000000 * UT_NSEC_PER_SEC, TIMER_PRECISION_HOUR);
   g_assert(tmp);
   g_test_queue_free(tmp);
 
-  tmp = timer_sec_msec_to_string(1000000, 999, TIMER_PRECISION_MINUTE);
+  tmp = timer_duration_to_string(1000000 * UT_NSEC_PER_SEC + 999 * UT_NSEC_PER_MSEC, TIMER_PRECISION_MINUTE);
   g_assert(tmp);
   g_test_queue_free(tmp);
 
-  tmp = timer_sec_msec_to_string(1, 1, TIMER_PRECISION_SECOND);
+  tmp = timer_duration_to_string(UT_NSEC_PER_SEC + UT_NSEC_PER_MSEC, TIMER_PRECISION_SECOND);
   g_assert(tmp);
   g_test_queue_free(tmp);
+
+  // longer than G_MAXUINT seconds
+  tmp = timer_duration_to_string(5000000000LL * UT_NSEC_PER_SEC + 7 * UT_NSEC_PER_MSEC, TIMER_PRECISION_MILLISECOND);
+  g_assert_cmpstr(tmp, ==, "57870 days 08:53:20.007 (5000000000.007 seconds)");
+  g_test_queue_free(tmp);
+
+  tmp = timer_duration_to_string(61 * UT_NSEC_PER_SEC + 1234567, TIMER_PRECISION_MICROSECOND);
+  g_assert_cmpstr(tmp, ==, "0 days 00:01:01.001234 (61.001234 seconds)");
+  g_test_queue_free(tmp);
+
+  tmp = timer_duration_to_string(61 * UT_NSEC_PER_SEC + 1234567, TIMER_PRECISION_NANOSECOND);
+  g_assert_cmpstr(tmp, ==, "0 days 00:01:01.001234567 (61.001234567 seconds)");
+  g_test_queue_free(tmp);
   g_debug("END: %s", __FUNCTION__);
 }
 
 /**
- * Basic tests for timer_add_seconds
+ * Basic tests for timer_add_time and ut_parse_time_pattern
  */
-static void test_timer_add_seconds()
+static void test_timer_add_time()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
-  guint init_sec = g_test_rand_int();
-  guint init_msec = g_test_rand_int();
+  ut_clock *clock = ut_clock_new();
+  ut_duration init = (guint) g_test_rand_int() * UT_NSEC_PER_MSEC;
+  ut_duration add = (guint) g_test_rand_int() * UT_NSEC_PER_SEC;
+  ut_duration parsed;
 
-  ut_timer *ttimer = timer_new_timer(init_sec, init_msec, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
+  ut_timer *ttimer = ut_timer_new_timer(init, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
   g_assert(ttimer);
-  g_test_queue_free(ttimer);
 
-  g_debug("ttimer->seconds = %u", ttimer->seconds);
+  timer_add_time(ttimer, add);
+  g_assert_cmpint(ttimer->length, ==, init + add);
 
-  guint add_sec = g_test_rand_int();
-  timer_add_seconds(ttimer, add_sec);
+  // saturates instead of wrapping around
+  timer_add_time(ttimer, UT_DURATION_MAX);
+  g_assert_cmpint(ttimer->length, ==, UT_DURATION_MAX);
 
-  guint result = ui_add(ui_add(init_sec, init_msec / 1000), add_sec);
+  g_assert(ut_parse_time_pattern("1d2h3m4s5ms", &parsed));
+  g_assert_cmpint(parsed, ==, 93784 * UT_NSEC_PER_SEC + 5 * UT_NSEC_PER_MSEC);
+  g_assert(ut_parse_time_pattern("1s250us3ns", &parsed));
+  g_assert_cmpint(parsed, ==, UT_NSEC_PER_SEC + 250 * UT_NSEC_PER_USEC + 3);
+  g_assert(ut_parse_time_pattern("5000000000s", &parsed));
+  g_assert_cmpint(parsed, ==, 5000000000LL * UT_NSEC_PER_SEC);
 
-  g_debug("ttimer->seconds = %u", ttimer->seconds);
-  g_debug("result = %u", result);
-  g_assert_cmpuint(ttimer->seconds, ==, result);
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
   g_debug("END: %s", __FUNCTION__);
 }
 
 /**
- * Basic tests for timer_add_milliseconds
+ * Tests the times understood by --until (see parse_until_pattern())
  */
-static void test_timer_add_milliseconds()
+static void test_parse_until_pattern()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
-  guint init_sec = g_test_rand_int();
-  guint init_msec = g_test_rand_int();
-
-  ut_timer *ttimer = timer_new_timer(init_sec, init_msec, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  g_assert(ttimer);
-  g_test_queue_free(ttimer);
-
-  g_debug("ttimer->mseconds = %u", ttimer->mseconds);
-
-  guint add_msec = g_test_rand_int();
-  timer_add_milliseconds(ttimer, add_msec);
-
-  guint result = ui_add(init_msec % 1000, add_msec % 1000);
-
-  g_debug("ttimer->mseconds = %u", ttimer->mseconds);
-  g_debug("result = %u", result);
-  g_assert_cmpuint(ttimer->mseconds, ==, result);
+  gint64 until, now = ut_clock_source_now(ut_clock_source_get_realtime());
+
+  g_assert(parse_until_pattern("@1275409800", &until));
+  g_assert_cmpint(until, ==, 1275409800 * UT_NSEC_PER_SEC);
+  g_assert(parse_until_pattern("@1275409800.25", &until));
+  g_assert_cmpint(until, ==, 1275409800 * UT_NSEC_PER_SEC + 250 * UT_NSEC_PER_MSEC);
+  g_assert(parse_until_pattern("2010-06-01T16:30:00Z", &until));
+  g_assert_cmpint(until, ==, 1275409800 * UT_NSEC_PER_SEC);
+  g_assert(parse_until_pattern("2010-06-01T18:30:00+02:00", &until));
+  g_assert_cmpint(until, ==, 1275409800 * UT_NSEC_PER_SEC);
+
+  // a time of day is the next time the clock shows it
+  g_assert(parse_until_pattern("12:00", &until));
+  g_assert_cmpint(until, >, now);
+  g_assert_cmpint(until, <=, now + 25 * 3600 * UT_NSEC_PER_SEC);
+  g_assert_cmpint(until % (60 * UT_NSEC_PER_SEC), ==, 0);
+  g_assert(parse_until_pattern("23:59:59", &until));
+  g_assert_cmpint(until, >, now);
+
+  g_assert(!parse_until_pattern("24:00", &until));
+  g_assert(!parse_until_pattern("12:60", &until));
+  g_assert(!parse_until_pattern("12:00:00am", &until));
+  g_assert(!parse_until_pattern("@", &until));
+  g_assert(!parse_until_pattern("@12s", &until));
+  g_assert(!parse_until_pattern("tomorrow", &until));
   g_debug("END: %s", __FUNCTION__);
 }
 
 /**
- * Basic tests for timer_get_progress_percent
+ * Tests a countdown ending at a time of the wall clock (--until)
  */
-static void test_timer_get_progress_percent_1()
+static void test_timer_until()
 {
   g_debug("START: %s", __FUNCTION__);
+  ut_clock *clock = ut_clock_new();
+  g_test_queue_free(clock);
+  g_assert(!loop);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  ut_timer *ttimer = ut_timer_new_countdown(0,
+                                            test_timer_succeeded,
+                                            test_timer_failed,
+                                            NULL,
+                                            test_context,
+                                            clock,
+                                            TIMER_PRECISION_DEFAULT,
+                                            NULL);
+  timer_set_until(ttimer, ut_clock_source_now(ut_clock_source_get_realtime()) + 50 * UT_NSEC_PER_MSEC);
+  g_assert(ttimer->until_source);
+  g_assert_cmpint(ttimer->length, >, 40 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ttimer->length - ut_clock_elapsed(clock), <=, 50 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ut_timer_get_progress_percent(ttimer), ==, 0);
 
-  ut_timer *ttimer = timer_new_timer(0, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
+  loop = g_main_loop_new(NULL, FALSE);
+  ut_timer_start(ttimer);
+  guint timeout_id = g_timeout_add(1000, (GSourceFunc) error_quitloop, NULL);
 
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, ==, 100);
+  g_main_loop_run(loop);
+  g_source_remove(timeout_id);
+  g_main_loop_unref(loop);
+  loop = NULL;
+
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert(ttimer->until_source == NULL);
+  g_assert_cmpint(ut_clock_source_now(ut_clock_source_get_realtime()), >=, ttimer->until);
+  g_assert_cmpint(ut_timer_get_progress_percent(ttimer), ==, 100);
+
+  ut_timer_destroy(ttimer);
   g_debug("END: %s", __FUNCTION__);
 }
 
-static void test_timer_get_progress_percent_2()
+static void test_countdown_expired(ut_timer *t, gpointer data)
 {
-  g_debug("START: %s", __FUNCTION__);
-
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  guint *expired = data;
 
-  ut_timer *ttimer = timer_new_timer(5, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  sleep(1);
-
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, <=, 25);
-  g_assert_cmpint(perc, >=, 20);
-  g_debug("END: %s", __FUNCTION__);
+  g_assert(ut_timer_has_expired(t));
+  (*expired)++;
 }
 
-static void test_timer_get_progress_percent_3()
+/**
+ * Runs many countdowns at once on a virtual clock: they share the timing
+ * wheel of the clock source, and all expire right on time
+ */
+static void test_timer_many()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  const guint count = 1000;
+  ut_clock *clock = test_clock_new_virtual();
+  ut_timer **timers = g_new(ut_timer*, count);
+  guint expired = 0;
+  guint i;
 
-  ut_timer *ttimer = timer_new_timer(100000, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, <=, 1);
-  g_debug("END: %s", __FUNCTION__);
-}
+  for (i = 0; i < count; i++)
+  {
+    ut_clock *c = ut_clock_new_with_source(clock->source);
+
+    timers[i] = ut_timer_new_countdown((i % 97 + 1) * 7 * UT_NSEC_PER_MSEC + i,
+                                       test_countdown_expired,
+                                       test_timer_failed,
+                                       &expired,
+                                       test_context,
+                                       c,
+                                       TIMER_PRECISION_DEFAULT,
+                                       NULL);
+    ut_timer_start(timers[i]);
+  }
+  g_assert(test_context_wheel(clock->source));
+  g_assert_cmpuint(test_context_wheel(clock->source)->count, ==, count);
 
-static void test_timer_get_progress_percent_4()
-{
-  g_debug("START: %s", __FUNCTION__);
+  // the virtual clock jumps from one deadline to the next: never idle
+  while (expired < count)
+    g_assert(g_main_context_iteration(NULL, FALSE));
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  g_assert_cmpuint(expired, ==, count);
+  g_assert(test_context_wheel(clock->source) == NULL);
+  for (i = 0; i < count; i++)
+  {
+    ut_clock *c = timers[i]->clock;
 
-  ut_timer *ttimer = timer_new_timer(0, 999, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  usleep(450000);
+    g_assert(timers[i]->wheel == NULL);
+    g_assert_cmpint(timers[i]->overshoot, ==, 0);
+    ut_timer_destroy(timers[i]);
+    ut_clock_destroy(c);
+  }
 
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, <=, 60);
-  g_assert_cmpint(perc, >=, 45);
+  g_free(timers);
   g_debug("END: %s", __FUNCTION__);
 }
 
-static void test_timer_get_progress_percent_5()
+#define TEST_WORKER_TIMERS 200
+
+/* A thread running its own set of countdowns on its own main context */
+typedef struct
 {
-  g_debug("START: %s", __FUNCTION__);
+  GMainContext *main_context;
+  ut_context *context;
+  guint expired;
+} test_worker;
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+static gpointer test_worker_run(test_worker *w)
+{
+  ut_timer *timers[TEST_WORKER_TIMERS];
+  guint i;
 
-  ut_timer *ttimer = timer_new_timer(1, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  usleep(500000);
+  for (i = 0; i < TEST_WORKER_TIMERS; i++)
+  {
+    timers[i] = ut_timer_new_countdown((i % 10 + 1) * 2 * UT_NSEC_PER_MSEC,
+                                       test_countdown_expired,
+                                       test_timer_failed,
+                                       &w->expired,
+                                       w->context,
+                                       ut_clock_new(),
+                                       TIMER_PRECISION_DEFAULT,
+                                       NULL);
+    ut_timer_start(timers[i]);
+  }
 
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, <=, 55);
-  g_assert_cmpint(perc, >=, 50);
-  g_debug("END: %s", __FUNCTION__);
-}
+  // all of them share one wheel, on the main context of the thread
+  g_assert(w->context->wheels && !w->context->wheels->next);
 
-static void test_timer_get_progress_percent_6()
-{
-  g_debug("START: %s", __FUNCTION__);
+  while (w->expired < TEST_WORKER_TIMERS)
+    g_main_context_iteration(w->main_context, TRUE);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  g_assert(!w->context->wheels);
+  for (i = 0; i < TEST_WORKER_TIMERS; i++)
+  {
+    ut_clock *c = timers[i]->clock;
 
-  ut_timer *ttimer = timer_new_timer(1000, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  sleep(10);
+    ut_timer_destroy(timers[i]);
+    ut_clock_destroy(c);
+  }
 
-  gint perc = timer_get_progress_percent(ttimer);
-  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
-  g_assert_cmpint(perc, ==, 1);
-  g_debug("END: %s", __FUNCTION__);
+  return NULL;
 }
 
-static void test_get_progress_bar()
+/**
+ * Runs countdowns on two threads at once, each with its own GMainContext
+ * and ut_context: nothing is shared but the (read-only) clock source, and
+ * nothing runs on the default main context.
+ */
+static void test_timer_threads()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  test_worker workers[2];
+  GThread *threads[2];
+  guint i;
 
-  ut_timer *ttimer = timer_new_timer(0, 999, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  usleep(450000);
+  for (i = 0; i < G_N_ELEMENTS(workers); i++)
+  {
+    workers[i].main_context = g_main_context_new();
+    workers[i].context = ut_context_new(workers[i].main_context);
+    workers[i].expired = 0;
+    g_assert(ut_context_get_main_context(workers[i].context) == workers[i].main_context);
+  }
 
-  gint8 perc = timer_get_progress_percent(ttimer);
-  gchar* bar = get_progress_bar(perc, 20, TRUE);
-  g_test_queue_free(bar);
-  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+  for (i = 0; i < G_N_ELEMENTS(workers); i++)
+    threads[i] = g_thread_create((GThreadFunc) test_worker_run, &workers[i], TRUE, NULL);
 
-  g_assert_cmpuint(strlen(bar), ==, 20);
+  for (i = 0; i < G_N_ELEMENTS(workers); i++)
+  {
+    g_thread_join(threads[i]);
+    g_assert_cmpuint(workers[i].expired, ==, TEST_WORKER_TIMERS);
+    ut_context_free(workers[i].context);
+    g_main_context_unref(workers[i].main_context);
+  }
 
+  g_assert(!test_context->wheels);
   g_debug("END: %s", __FUNCTION__);
 }
 
-static void test_get_progress_bar2()
+/**
+ * Tests reading the timers of --batch, and running them on a virtual clock
+ */
+static void test_batch()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  ut_clock *clock = test_clock_new_virtual();
+  gchar buf[1024], line[64];
+  gint fds[2];
+  gssize len;
+  ut_batch *b;
+
+  g_assert(pipe(fds) == 0);
+  b = batch_new(test_context, clock->source, STREAM_FORMAT_CSV, fds[1], test_batch_done, NULL);
+
+  g_stpcpy(line, "  slow\tcountdown   1m30s ");
+  g_assert(batch_add_line(b, line));
+  g_stpcpy(line, "fast timer 250ms");
+  g_assert(batch_add_line(b, line));
+  g_stpcpy(line, "fast-2 countdown 250ms");
+  g_assert(batch_add_line(b, line));
+
+  g_stpcpy(line, "stopwatch 1s");
+  g_assert(!batch_add_line(b, line));
+  g_stpcpy(line, "sw stopwatch 1s");
+  g_assert(!batch_add_line(b, line));
+  g_stpcpy(line, "a b timer 1s");
+  g_assert(!batch_add_line(b, line));
+  g_stpcpy(line, "\"quoted\" timer 1s");
+  g_assert(!batch_add_line(b, line));
+  g_assert_cmpuint(b->jobs->len, ==, 3);
 
-  ut_timer *ttimer = timer_new_timer(0, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
-  usleep(450000);
-
-  gint8 perc = timer_get_progress_percent(ttimer);
-  gchar* bar = get_progress_bar(perc, 30, TRUE);
-  g_test_queue_free(bar);
-  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+  g_assert(!loop);
+  loop = g_main_loop_new(NULL, FALSE);
+  batch_start(b);
+  g_assert_cmpuint(test_context_wheel(clock->source)->count, ==, 3);
+  g_main_loop_run(loop);
+  g_main_loop_unref(loop);
+  loop = NULL;
 
-  g_assert_cmpuint(strlen(bar), ==, 30);
+  g_assert(ut_config.current_exit_status_code == EXIT_SUCCESS);
+  g_assert_cmpuint(b->done, ==, 3);
+  // the jobs stay in the table of the wheel, disarmed, until freed
+  g_assert_cmpuint(b->wheel->timers->count, ==, 3);
+  g_assert_cmpuint(b->wheel->count, ==, 0);
+  batch_free(b);
+  g_assert(test_context_wheel(clock->source) == NULL);
+
+  close(fds[1]);
+  len = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  g_assert_cmpint(len, >, 0);
+  buf[len] = '\0';
+  g_assert_cmpstr(buf, ==, "name,mode,requested_ns,actual_ns,lateness_ns\n"
+                           "fast,timer,250000000,250000000,0\n"
+                           "fast-2,countdown,250000000,250000000,0\n"
+                           "slow,countdown,90000000000,90000000000,0\n");
 
   g_debug("END: %s", __FUNCTION__);
 }
 
-static void test_get_progress_bar3()
+/**
+ * Tests that a ut_clock does not count the time it is stopped
+ */
+static void test_clock()
 {
   g_debug("START: %s", __FUNCTION__);
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+  ut_clock *clock = test_clock_new_virtual();
+  ut_clock *real = ut_clock_new();
+  ut_duration elapsed;
 
-  ut_timer *ttimer = timer_new_timer(0, 0, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  ut_clock_stop(clock);
+  elapsed = ut_clock_elapsed(clock);
+  g_assert_cmpint(elapsed, ==, 10 * UT_NSEC_PER_MSEC);
 
-  gint8 perc = timer_get_progress_percent(ttimer);
-  gchar* bar = get_progress_bar(perc, 30, TRUE);
-  g_test_queue_free(bar);
-  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ut_clock_elapsed(clock), ==, elapsed);
 
-  g_assert_cmpuint(strlen(bar), ==, 30);
+  ut_clock_continue(clock);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  g_assert_cmpint(ut_clock_elapsed(clock), ==, elapsed + 10 * UT_NSEC_PER_MSEC);
 
+  // spinning on a virtual clock jumps to the target
+  g_assert_cmpint(ut_clock_spin_until(clock, UT_NSEC_PER_SEC), ==, UT_NSEC_PER_SEC);
+
+  ut_clock_start(clock);
+  g_assert_cmpint(ut_clock_elapsed(clock), ==, 0);
+
+  // the default clock source follows CLOCK_MONOTONIC
+  usleep(1000);
+  g_assert_cmpint(ut_clock_elapsed(real), >=, UT_NSEC_PER_MSEC);
+  ut_clock_destroy(real);
   g_debug("END: %s", __FUNCTION__);
 }
 
-static void test_get_progress_bar4()
+/* Reads a clock over and over while another thread stops and continues it */
+typedef struct
 {
-  g_debug("START: %s", __FUNCTION__);
+  ut_clock *clock;
+  volatile gint done;
+  guint reads;
+} test_clock_reader;
 
-  GTimer *gtimer = g_timer_new();
-  g_test_queue_free(gtimer);
+static gpointer test_clock_read(test_clock_reader *r)
+{
+  ut_duration last = 0, elapsed;
+
+  while (!g_atomic_int_get(&r->done))
+  {
+    elapsed = ut_clock_elapsed(r->clock);
+    // a torn read of the state would go back in time, or jump forward
+    g_assert_cmpint(elapsed, >=, last);
+    last = elapsed;
+    r->reads++;
+  }
+
+  return NULL;
+}
+
+/**
+ * Tests that a ut_clock read from a thread while another one stops and
+ * continues it always gives a consistent elapsed time
+ */
+static void test_clock_threads()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  test_clock_reader r;
+  GThread *thread;
+  gint64 begin = ut_clock_now();
+  guint i;
+
+  r.clock = ut_clock_new();
+  r.done = 0;
+  r.reads = 0;
+  thread = g_thread_create((GThreadFunc) test_clock_read, &r, TRUE, NULL);
+
+  for (i = 0; i < 100000; i++)
+  {
+    ut_clock_stop(r.clock);
+    g_assert(!ut_clock_is_active(r.clock));
+    ut_clock_continue(r.clock);
+  }
+
+  g_atomic_int_set(&r.done, 1);
+  g_thread_join(thread);
+
+  g_assert(ut_clock_is_active(r.clock));
+  g_assert_cmpint(ut_clock_elapsed(r.clock), <=, ut_clock_now() - begin);
+  g_debug("%s: %u reads", __FUNCTION__, r.reads);
+  ut_clock_destroy(r.clock);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests the clock sources selected by --clock, and their fallback
+ */
+static void test_clock_sources()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock_source_type type;
+  ut_clock_source *s;
+  gint64 before, after;
+
+  g_assert(ut_clock_source_type_from_string("TSC", &type));
+  g_assert_cmpint(type, ==, UT_CLOCK_SOURCE_TSC);
+  g_assert(ut_clock_source_type_from_string("monotonic_raw", &type));
+  g_assert_cmpstr(ut_clock_source_type_to_string(type), ==, "monotonic_raw");
+  g_assert(!ut_clock_source_type_from_string("tai", &type));
+
+  for (type = UT_CLOCK_SOURCE_MONOTONIC; type < UT_CLOCK_SOURCE_VIRTUAL; type++)
+  {
+    s = ut_clock_source_new(type);
+    g_test_message("%s clock: %s", ut_clock_source_type_to_string(type),
+                   s->type == type ? "available" : "falling back to monotonic");
+    g_assert(s->type == type || s->type == UT_CLOCK_SOURCE_MONOTONIC);
+
+    before = ut_clock_source_now(s);
+    usleep(1000);
+    after = ut_clock_source_now(s);
+    g_assert_cmpint(after - before, >=, UT_NSEC_PER_MSEC);
+    g_assert_cmpint(after - before, <, UT_NSEC_PER_SEC);
+
+    // the TSC starts at the monotonic time it was calibrated with
+    if (s->type == UT_CLOCK_SOURCE_TSC)
+      g_assert_cmpint(ABS(ut_clock_source_now(s) - ut_clock_now()), <, UT_NSEC_PER_MSEC);
+
+    ut_clock_source_free(s);
+  }
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static gboolean test_signal_received(gint signum, gpointer data)
+{
+  guint *received = data;
+
+  if (signum == SIGUSR1)
+    *received |= 1;
+  else if (signum == SIGWINCH)
+  {
+    *received |= 2;
+    ut_context_resized(test_context);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Tests that the signals raised are dispatched from the main loop, and that
+ * a resize only asks the next frame to measure the terminal again, and that
+ * freeing the source leaves blocked the signals that were blocked before
+ */
+static void test_signal_source()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  const gint signals[] = { SIGUSR1, SIGWINCH };
+  GSource *source;
+  sigset_t blocked, mask;
+  guint received = 0;
+  guint i;
+
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGWINCH);
+  pthread_sigmask(SIG_BLOCK, &blocked, NULL);
+
+  ut_context_get_cols(test_context);
+  g_assert(test_context->cols_known);
+  test_context->redraw = FALSE;
+
+  source = signal_source_new(signals, G_N_ELEMENTS(signals));
+  g_source_set_callback(source, (GSourceFunc) test_signal_received, &received, NULL);
+  g_source_attach(source, ut_context_get_main_context(test_context));
+
+  // without the source, SIGUSR1 would terminate the tests
+  raise(SIGUSR1);
+  raise(SIGWINCH);
+  g_assert_cmpuint(received, ==, 0);
+
+  for (i = 0; i < 1000 && received != 3; i++)
+    g_main_context_iteration(ut_context_get_main_context(test_context), FALSE);
+
+  g_assert_cmpuint(received, ==, 3);
+  g_assert(!test_context->cols_known);
+  g_assert(test_context->redraw);
+
+  // still pending when the source is freed, it must not terminate the tests
+  raise(SIGUSR1);
+  g_source_destroy(source);
+  g_source_unref(source);
+  g_main_context_iteration(ut_context_get_main_context(test_context), FALSE);
+
+  pthread_sigmask(SIG_BLOCK, NULL, &mask);
+  g_assert(sigismember(&mask, SIGWINCH) == 1);
+  g_assert(sigismember(&mask, SIGUSR1) == 0);
+  pthread_sigmask(SIG_UNBLOCK, &blocked, NULL);
+
+  ut_context_get_cols(test_context);
+  test_context->redraw = FALSE;
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Basic tests for ut_timer_get_progress_percent
+ */
+static void test_timer_get_progress_percent_1()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(0, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, ==, 100);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_timer_get_progress_percent_2()
+{
+  g_debug("START: %s", __FUNCTION__);
 
-  ut_timer *ttimer = timer_new_timer(0, 500, success_quitloop, error_quitloop, gtimer, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock *clock = test_clock_new_virtual();
 
-  gint8 perc = timer_get_progress_percent(ttimer);
+  ut_timer *ttimer = ut_timer_new_timer(5 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, UT_NSEC_PER_SEC);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, ==, 20);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_timer_get_progress_percent_3()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(100000 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, <=, 1);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_timer_get_progress_percent_4()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(999 * UT_NSEC_PER_MSEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 450 * UT_NSEC_PER_MSEC);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, ==, 45);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_timer_get_progress_percent_5()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(1 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 500 * UT_NSEC_PER_MSEC);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, ==, 50);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_timer_get_progress_percent_6()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(1000 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_SEC);
+
+  gint perc = ut_timer_get_progress_percent(ttimer);
+  g_debug("%s: Returned perc: %d", __FUNCTION__, perc);
+  g_assert_cmpint(perc, ==, 1);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_get_progress_bar()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(999 * UT_NSEC_PER_MSEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 450 * UT_NSEC_PER_MSEC);
+
+  gint8 perc = ut_timer_get_progress_percent(ttimer);
+  gchar* bar = get_progress_bar(perc, 20, TRUE);
+  g_test_queue_free(bar);
+  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+
+  g_assert_cmpuint(strlen(bar), ==, 20);
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_get_progress_bar2()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(0, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  ut_clock_source_advance(clock->source, 450 * UT_NSEC_PER_MSEC);
+
+  gint8 perc = ut_timer_get_progress_percent(ttimer);
+  gchar* bar = get_progress_bar(perc, 30, TRUE);
+  g_test_queue_free(bar);
+  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+
+  g_assert_cmpuint(strlen(bar), ==, 30);
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_get_progress_bar3()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(0, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+
+  gint8 perc = ut_timer_get_progress_percent(ttimer);
+  gchar* bar = get_progress_bar(perc, 30, TRUE);
+  g_test_queue_free(bar);
+  g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
+
+  g_assert_cmpuint(strlen(bar), ==, 30);
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+static void test_get_progress_bar4()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+
+  ut_timer *ttimer = ut_timer_new_timer(500 * UT_NSEC_PER_MSEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+
+  gint8 perc = ut_timer_get_progress_percent(ttimer);
   gchar* bar = get_progress_bar(perc, 30, TRUE);
   g_test_queue_free(bar);
   g_debug("%s: Returned bar: %s", __FUNCTION__, bar);
@@ -553,6 +1387,739 @@ static void test_get_progress_bar_width()
   g_debug("END: %s", __FUNCTION__);
 }
 
+/**
+ * Tests that the frames built for timer_print fit in the terminal
+ */
+static void test_timer_build_frame()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+  timer_display display = { .perc = TRUE, .text = TRUE, .bar = TRUE };
+  gushort cols;
+
+  ut_timer *ttimer = ut_timer_new_countdown(3600 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &display);
+  progress_frame *frame = progress_frame_new();
+
+  g_assert(!timer_build_frame(ttimer, frame, 3));
+
+  for (cols = 4; cols <= 300; cols++)
+  {
+    g_assert(timer_build_frame(ttimer, frame, cols));
+    g_assert_cmpuint(frame->len, ==, strlen(frame->line));
+    g_assert_cmpuint(frame->len, <=, cols - 2);
+  }
+
+  // with a wide terminal, everything is displayed, the bar takes what is left
+  g_assert(timer_build_frame(ttimer, frame, 200));
+  g_assert(g_str_has_prefix(frame->line, "Time Remaining: "));
+  g_assert(strstr(frame->line, "%) ["));
+  g_assert_cmpuint(frame->len, ==, 198);
+
+  progress_frame_free(frame);
+  ut_timer_destroy(ttimer);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests the records written by --format
+ */
+static void test_timer_build_record()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+  gchar buf[STREAM_RECORD_MAX];
+  stream_format format;
+  stream_record record = { "countdown", G_GINT64_CONSTANT(1500000000),
+                           G_GINT64_CONSTANT(8500000000), 15, FALSE };
+
+  g_assert(stream_format_from_string("jsonl", &format));
+  g_assert_cmpint(format, ==, STREAM_FORMAT_JSONL);
+  g_assert(stream_format_from_string("CSV", &format));
+  g_assert_cmpint(format, ==, STREAM_FORMAT_CSV);
+  g_assert(!stream_format_from_string("xml", &format));
+
+  g_assert_cmpuint(stream_format_header(buf, sizeof(buf), STREAM_FORMAT_JSONL), ==, 0);
+  stream_format_header(buf, sizeof(buf), STREAM_FORMAT_TSV);
+  g_assert_cmpstr(buf, ==, "mode\telapsed_ns\tremaining_ns\tpercent\tpaused\n");
+
+  stream_format_record(buf, sizeof(buf), STREAM_FORMAT_JSONL, &record);
+  g_assert_cmpstr(buf, ==, "{\"mode\":\"countdown\",\"elapsed_ns\":1500000000,"
+                           "\"remaining_ns\":8500000000,\"percent\":15,\"paused\":false}\n");
+  stream_format_record(buf, sizeof(buf), STREAM_FORMAT_CSV, &record);
+  g_assert_cmpstr(buf, ==, "countdown,1500000000,8500000000,15,0\n");
+
+  // a stopwatch has no remaining time nor percentage
+  ut_timer *ttimer = ut_timer_new_stopwatch(test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, NULL);
+  ut_timer_pause(ttimer);
+
+  g_assert_cmpuint(timer_build_record(ttimer, buf, sizeof(buf), STREAM_FORMAT_JSONL), ==, strlen(buf));
+  g_assert(g_str_has_prefix(buf, "{\"mode\":\"stopwatch\",\"elapsed_ns\":"));
+  g_assert(g_str_has_suffix(buf, ",\"remaining_ns\":null,\"percent\":null,\"paused\":true}\n"));
+  timer_build_record(ttimer, buf, sizeof(buf), STREAM_FORMAT_CSV);
+  g_assert(g_str_has_suffix(buf, ",,,1\n"));
+
+  ut_timer_destroy(ttimer);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+#ifdef TEST_COUNT_ALLOCATIONS
+/**
+ * Tests that building a frame does not allocate once in steady state
+ */
+static void test_timer_build_frame_allocations()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+  timer_display display = { .perc = TRUE, .text = TRUE, .bar = TRUE };
+  gint i, count, frames = 1000;
+  ut_timer *ttimer;
+  progress_frame *frame = progress_frame_new();
+
+  ttimer = ut_timer_new_countdown(3600 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &display);
+
+  // the first frame sizes the line buffer (and gettext caches its lookups)
+  for (i = 0; i < 3; i++)
+    timer_build_frame(ttimer, frame, 120);
+
+  count = allocations_get_count();
+  for (i = 0; i < frames; i++)
+    timer_build_frame(ttimer, frame, 120);
+  count = allocations_get_count() - count;
+
+  g_debug("%s: %d allocations for %d frames", __FUNCTION__, count, frames);
+  g_assert_cmpint(count, ==, 0);
+
+  ut_timer_destroy(ttimer);
+
+  ttimer = ut_timer_new_timer(10 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_SECOND, &display);
+  timer_build_frame(ttimer, frame, 120);
+
+  count = allocations_get_count();
+  for (i = 0; i < frames; i++)
+    timer_build_frame(ttimer, frame, 120);
+  count = allocations_get_count() - count;
+
+  g_assert_cmpint(count, ==, 0);
+
+  ut_timer_destroy(ttimer);
+  progress_frame_free(frame);
+  g_debug("END: %s", __FUNCTION__);
+}
+#endif
+
+/**
+ * Tests when the displayed line is expected to change next. The timers run
+ * on a virtual clock, so the time to the next change is exact.
+ */
+static void test_timer_get_next_change()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_clock *clock = test_clock_new_virtual();
+  timer_display text = { .perc = FALSE, .text = TRUE, .bar = FALSE };
+  timer_display perc = { .perc = TRUE, .text = FALSE, .bar = FALSE };
+  timer_display bar = { .perc = FALSE, .text = FALSE, .bar = TRUE };
+  ut_timer *ttimer;
+  ut_duration next;
+
+  // countdown: the remaining seconds change in (almost) a second
+  ttimer = ut_timer_new_countdown(10 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_SECOND, &text);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  next = timer_get_next_change(ttimer);
+  g_assert_cmpint(next, ==, 990 * UT_NSEC_PER_MSEC);
+
+  // paused: nothing changes
+  ut_timer_pause(ttimer);
+  g_assert_cmpint(timer_get_next_change(ttimer), ==, -1);
+  ut_timer_resume(ttimer);
+  ut_timer_destroy(ttimer);
+
+  // timer: the elapsed minutes change in (almost) a minute
+  ut_clock_start(clock);
+  ttimer = ut_timer_new_timer(3600 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MINUTE, &text);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  next = timer_get_next_change(ttimer);
+  g_assert_cmpint(next, ==, 60 * UT_NSEC_PER_SEC - 10 * UT_NSEC_PER_MSEC);
+  ut_timer_destroy(ttimer);
+
+  // percentage: rounded to the next 1% of 100 seconds, at 0.5 s
+  ut_clock_start(clock);
+  ttimer = ut_timer_new_timer(100 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &perc);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  next = timer_get_next_change(ttimer);
+  g_assert_cmpint(next, ==, 490 * UT_NSEC_PER_MSEC);
+  ut_timer_destroy(ttimer);
+
+  // bar: rounded to the next 1% of 10000 seconds, at 50 s
+  ut_clock_start(clock);
+  ttimer = ut_timer_new_timer(10000 * UT_NSEC_PER_SEC, test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &bar);
+  ut_clock_source_advance(clock->source, 10 * UT_NSEC_PER_MSEC);
+  next = timer_get_next_change(ttimer);
+  g_assert_cmpint(next, ==, 50 * UT_NSEC_PER_SEC - 10 * UT_NSEC_PER_MSEC);
+  ut_timer_destroy(ttimer);
+
+  // a stopwatch only showing a percentage never changes
+  ttimer = ut_timer_new_stopwatch(test_timer_succeeded, test_timer_failed, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &perc);
+  g_assert_cmpint(timer_get_next_change(ttimer), ==, -1);
+  ut_timer_destroy(ttimer);
+
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests the percentiles of a stats_histogram
+ */
+static void test_stats_histogram()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  stats_histogram *h = g_new(stats_histogram, 1);
+  ut_duration p;
+  gint i;
+
+  stats_histogram_init(h);
+  g_assert_cmpint(stats_histogram_percentile(h, 50), ==, 0);
+
+  // small values are exact
+  for (i = 0; i < 10; i++)
+    stats_histogram_record(h, i);
+  g_assert_cmpint(stats_histogram_percentile(h, 50), ==, 4);
+  g_assert_cmpint(stats_histogram_percentile(h, 100), ==, 9);
+
+  // 1 to 1000 us: within the precision of a bucket (1/16)
+  stats_histogram_init(h);
+  for (i = 1000; i >= 1; i--)
+    stats_histogram_record(h, i * UT_NSEC_PER_USEC);
+  g_assert_cmpuint(h->count, ==, 1000);
+  g_assert_cmpint(h->max, ==, 1000 * UT_NSEC_PER_USEC);
+
+  p = stats_histogram_percentile(h, 50);
+  g_assert_cmpint(p, >=, 500 * UT_NSEC_PER_USEC);
+  g_assert_cmpint(p, <=, 500 * UT_NSEC_PER_USEC * 17 / 16);
+  p = stats_histogram_percentile(h, 99);
+  g_assert_cmpint(p, >=, 990 * UT_NSEC_PER_USEC);
+  g_assert_cmpint(p, <=, h->max);
+
+  // the largest durations still fit, negative ones count as 0
+  stats_histogram_record(h, UT_DURATION_MAX);
+  stats_histogram_record(h, -1);
+  g_assert_cmpint(stats_histogram_percentile(h, 100), ==, UT_DURATION_MAX);
+  g_assert_cmpint(stats_histogram_percentile(h, 0), ==, 0);
+
+  g_free(h);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Checks that a timer of a wheel expires in the first run at or after its
+ * deadline, never before.
+ */
+static gint64 test_wheel_last = -1, test_wheel_now = 0;
+static guint test_wheel_fired = 0;
+
+static void test_wheel_expired(ut_timer_table *table, ut_timer_handle handle, gpointer data)
+{
+  g_assert_cmpint(timer_table_get_deadline(table, handle), <=, test_wheel_now);
+  g_assert_cmpint(timer_table_get_deadline(table, handle), >, test_wheel_last);
+  g_assert(!timer_table_is_armed(table, handle));
+  g_assert(data == &test_wheel_fired);
+  test_wheel_fired++;
+}
+
+/**
+ * Tests a ut_wheel with deadlines from nanoseconds to days away, some of
+ * them cancelled or removed, run at random steps
+ */
+static void test_wheel()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  const guint count = 5000;
+  const gint64 day = G_GINT64_CONSTANT(86400) * UT_NSEC_PER_SEC;
+  ut_wheel *w = wheel_new(NULL, NULL);
+  ut_timer_handle *timers = g_new(ut_timer_handle, count);
+  ut_clock_source *source;
+  guint i, armed = 0;
+  gint64 next, earliest, now;
+
+  g_assert_cmpint(wheel_next_deadline(w), ==, DEADLINE_NONE);
+  g_assert_cmpuint(wheel_run(w, G_GINT64_CONSTANT(1) << 40), ==, 0);
+  wheel_free(w);
+
+  w = wheel_new(NULL, NULL);
+  test_wheel_last = -1;
+  test_wheel_now = 0;
+  test_wheel_fired = 0;
+
+  for (i = 0; i < count; i++)
+  {
+    // 2^0 to 2^46 ns (about 20 hours)
+    gint64 deadline = (gint64) g_test_rand_int() >> g_test_rand_int_range(0, 32);
+
+    deadline <<= g_test_rand_int_range(0, 15);
+    timers[i] = wheel_add_timer(w, test_wheel_expired, &test_wheel_fired, NULL);
+    wheel_arm(w, timers[i], deadline);
+  }
+  g_assert_cmpuint(w->count, ==, count);
+  // the timers all share one callback
+  g_assert_cmpuint(w->timers->nfuncs, ==, 1);
+
+  // moving a timer, disarming one out of eight and removing another
+  wheel_arm(w, timers[0], 42);
+  g_assert_cmpint(timer_table_get_deadline(w->timers, timers[0]), ==, 42);
+  for (i = 0; i < count; i++)
+  {
+    if (i % 8 == 3)
+      wheel_disarm(w, timers[i]);
+    else if (i % 8 == 7)
+      wheel_remove_timer(w, timers[i]);
+    else
+      armed++;
+  }
+  g_assert_cmpuint(w->count, ==, armed);
+  g_assert_cmpuint(w->timers->count, ==, count - count / 8);
+
+  while ((next = wheel_next_deadline(w)) != DEADLINE_NONE)
+  {
+    guint fired = test_wheel_fired;
+
+    // the next deadline is the earliest timer, whatever its level
+    earliest = G_MAXINT64;
+    for (i = 0; i < count; i++)
+      if (timer_table_is_armed(w->timers, timers[i]))
+        earliest = MIN(earliest, timer_table_get_deadline(w->timers, timers[i]));
+    g_assert_cmpint(next, ==, earliest);
+
+    test_wheel_now = MAX(next, test_wheel_now) + g_test_rand_int_range(0, 2) * g_test_rand_int_range(0, 1 << 30);
+    g_assert_cmpuint(wheel_run(w, test_wheel_now), ==, test_wheel_fired - fired);
+    test_wheel_last = test_wheel_now;
+  }
+
+  g_assert_cmpuint(test_wheel_fired, ==, armed);
+  g_assert_cmpuint(w->count, ==, 0);
+  for (i = 0; i < count; i++)
+  {
+    g_assert(!timer_table_is_armed(w->timers, timers[i]));
+    // the expired and disarmed timers stay in the table
+    g_assert(timer_table_is_valid(w->timers, timers[i]) == (i % 8 != 7));
+  }
+  wheel_free(w);
+
+  // the deadline source follows the earliest timer, a day away or removed
+  source = ut_clock_source_new_virtual();
+  w = wheel_new(source, NULL);
+  now = ut_clock_source_now(source);
+  timers[0] = wheel_add_timer(w, test_wheel_expired, &test_wheel_fired, NULL);
+  timers[1] = wheel_add_timer(w, test_wheel_expired, &test_wheel_fired, NULL);
+  wheel_arm(w, timers[0], now + day);
+  g_assert_cmpint(w->armed_at, ==, now + day);
+  wheel_arm(w, timers[1], now + 10);
+  g_assert_cmpint(w->armed_at, ==, now + 10);
+  wheel_arm(w, timers[1], now + 2 * day);
+  g_assert_cmpint(w->armed_at, ==, now + day);
+  wheel_disarm(w, timers[0]);
+  g_assert_cmpint(w->armed_at, ==, now + 2 * day);
+  wheel_remove_timer(w, timers[1]);
+  g_assert_cmpint(w->armed_at, ==, DEADLINE_NONE);
+  wheel_free(w);
+  g_main_context_iteration(NULL, FALSE);
+  ut_clock_source_free(source);
+
+  g_free(timers);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Tests the handles, the data and the free list of a ut_timer_table
+ */
+static void test_timer_table()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  ut_timer_table *table = timer_table_new(0);
+  ut_timer_handle handles[100], stale, handle;
+  guint callback, i, index, reuses = 0;
+
+  callback = timer_table_add_callback(table, test_wheel_expired, &test_wheel_fired);
+  g_assert_cmpuint(timer_table_add_callback(table, test_wheel_expired, &test_wheel_fired), ==, callback);
+  g_assert_cmpuint(timer_table_add_callback(table, test_wheel_expired, NULL), !=, callback);
+  g_assert(!timer_table_is_valid(table, TIMER_HANDLE_NONE));
+
+  // growing past the initial capacity
+  for (i = 0; i < G_N_ELEMENTS(handles); i++)
+  {
+    handles[i] = timer_table_add(table, callback, GUINT_TO_POINTER(i));
+    g_assert(handles[i] != TIMER_HANDLE_NONE);
+    g_assert_cmpuint(timer_handle_index(handles[i]), ==, i);
+  }
+  g_assert_cmpuint(table->count, ==, 100);
+  g_assert(timer_table_get_data(table, handles[10]) == GUINT_TO_POINTER(10));
+  g_assert(!timer_table_is_armed(table, handles[10]));
+  g_assert_cmpint(timer_table_get_deadline(table, handles[10]), ==, DEADLINE_NONE);
+
+  // a removed handle is stale, even once its slot is reused
+  stale = handles[50];
+  g_assert(timer_table_remove(table, stale));
+  g_assert(!timer_table_remove(table, stale));
+  g_assert(!timer_table_is_valid(table, stale));
+  g_assert(timer_table_get_data(table, stale) == NULL);
+  handles[50] = timer_table_add(table, callback, NULL);
+  g_assert_cmpuint(timer_handle_index(handles[50]), ==, 50);
+  g_assert(handles[50] != stale);
+  g_assert(!timer_table_is_valid(table, stale));
+  g_assert_cmpuint(table->size, ==, 100);
+
+  for (i = 0; i < G_N_ELEMENTS(handles); i++)
+    g_assert(timer_table_remove(table, handles[i]));
+  g_assert_cmpuint(table->count, ==, 0);
+
+  // churning a slot: once out of generations it is retired, not wrapped
+  stale = timer_table_add(table, callback, NULL);
+  index = timer_handle_index(stale);
+  g_assert(timer_table_remove(table, stale));
+  do
+  {
+    handle = timer_table_add(table, callback, NULL);
+    g_assert(handle != stale);
+    g_assert(timer_table_remove(table, handle));
+    reuses++;
+  } while (timer_handle_index(handle) == index);
+  g_assert_cmpuint(reuses, ==, TIMER_TABLE_MAX_GENERATION - 1);
+  g_assert(!timer_table_is_valid(table, stale));
+  g_assert_cmpuint(table->size, ==, 100);
+
+  timer_table_free(table);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Applies the output of a progress_renderer to a one-line "terminal".
+ * Only understands what the renderer emits: \r, CUF (ESC[nC), EL (ESC[K)
+ * and ASCII text.
+ */
+static void test_terminal_apply(gchar *screen, gsize size, gsize *col,
+                                const gchar *out, gsize len)
+{
+  gsize i = 0;
+
+  while (i < len)
+  {
+    if (out[i] == '\r')
+    {
+      *col = 0;
+      i++;
+    }
+    else if (out[i] == '\033')
+    {
+      gchar *end;
+      gulong n = strtoul(out + i + 2, &end, 10);
+
+      g_assert(out[i + 1] == '[');
+      if (*end == 'C')
+        *col += n;
+      else
+      {
+        g_assert(*end == 'K');
+        memset(screen + *col, ' ', size - *col);
+      }
+      i = end - out + 1;
+    }
+    else
+    {
+      g_assert_cmpuint(*col, <, size);
+      screen[(*col)++] = out[i++];
+    }
+  }
+}
+
+/* Returns the number of blanks of screen from col to its end (size): the
+ * screen is not a string, it is only read within its size. */
+static gsize test_terminal_blanks(const gchar *screen, gsize size, gsize col)
+{
+  gsize i;
+
+  for (i = col; i < size && screen[i] == ' '; i++)
+    ;
+  return i - col;
+}
+
+/* Builds the line of a countdown of total_ms, remaining_ms from the end. */
+static void test_build_countdown_line(progress_frame *frame, guint remaining_ms, guint total_ms, gushort width)
+{
+  gchar text[TIMER_TEXT_MAX], perc_str[16];
+  gint8 perc = (gint8) ((guint64) (total_ms - remaining_ms) * 100 / total_ms);
+  gint len;
+
+  progress_frame_reset(frame, width);
+  progress_frame_append(frame, "Time Remaining: ", 16);
+  len = timer_format_duration(text, sizeof(text), remaining_ms * UT_NSEC_PER_MSEC, TIMER_PRECISION_MILLISECOND);
+  progress_frame_append(frame, text, len);
+  len = g_snprintf(perc_str, sizeof(perc_str), " (%i%%) ", perc);
+  progress_frame_append(frame, perc_str, len);
+  progress_frame_append_bar(frame, perc, width - frame->len - 1, FALSE);
+}
+
+/**
+ * Tests that the screen matches the frames drawn by a progress_renderer
+ */
+static void test_progress_renderer()
+{
+  g_debug("START: %s", __FUNCTION__);
+
+  gchar screen[256];
+  gsize col = 0;
+  guint i, remaining;
+  progress_frame *frame = progress_frame_new();
+  progress_renderer *r = progress_renderer_new(-1);
+  const gchar *lines[] = { "abcdef", "abXdef", "abXdef", "abc", "", "a",
+                           "0123456789012345678901234567890123456789",
+                           "0123X56789012345678901234567890123456Y89",
+                           "Z", "short line" };
+
+  memset(screen, ' ', sizeof(screen));
+
+  for (i = 0; i < G_N_ELEMENTS(lines); i++)
+  {
+    gsize len = strlen(lines[i]);
+
+    progress_renderer_update(r, lines[i], len);
+    test_terminal_apply(screen, sizeof(screen), &col, r->out, r->out_len);
+
+    g_assert(strncmp(screen, lines[i], len) == 0);
+    g_assert_cmpuint(test_terminal_blanks(screen, sizeof(screen), len), ==, sizeof(screen) - len);
+    g_assert_cmpuint(col, ==, len);
+  }
+
+  // a line that did not change is not written again
+  progress_renderer_update(r, "short line", 10);
+  g_assert_cmpuint(r->out_len, ==, 0);
+
+  // after an invalidation, the line is fully redrawn
+  progress_renderer_invalidate(r);
+  progress_renderer_update(r, "short line", 10);
+  g_assert_cmpuint(r->out_len, ==, 14);
+
+  for (remaining = 90000; remaining > 80000; remaining -= 89)
+  {
+    test_build_countdown_line(frame, remaining, 90000, 120);
+    progress_renderer_update(r, frame->line, frame->len);
+    test_terminal_apply(screen, sizeof(screen), &col, r->out, r->out_len);
+
+    g_assert(strncmp(screen, frame->line, frame->len) == 0);
+    g_assert_cmpuint(col, ==, frame->len);
+  }
+
+  progress_renderer_free(r);
+  progress_frame_free(frame);
+  g_debug("END: %s", __FUNCTION__);
+}
+
+/**
+ * Benchmark: bytes written by the progress_renderer compared to rewriting
+ * the whole line every frame (as "\r%s ")
+ */
+static void test_perf_progress_renderer_bytes()
+{
+  guint64 full = 0, damage = 0;
+  guint frames = 0, remaining, total = 3600 * 1000;
+  progress_frame *frame = progress_frame_new();
+  progress_renderer *r = progress_renderer_new(-1);
+
+  // ten minutes of a one hour countdown, refreshed every 89 ms
+  for (remaining = total; remaining > total - 600 * 1000; remaining -= 89)
+  {
+    test_build_countdown_line(frame, remaining, total, 80);
+    full += frame->len + 2;
+    damage += progress_renderer_update(r, frame->line, frame->len);
+    frames++;
+  }
+
+  g_test_message("%u frames: %" G_GUINT64_FORMAT " bytes for full redraws,"
+                 " %" G_GUINT64_FORMAT " bytes with damage tracking",
+                 frames, full, damage);
+  g_test_minimized_result((gdouble) damage / frames, "bytes per frame with damage tracking");
+  g_test_maximized_result((gdouble) full / damage, "bytes written reduction factor");
+  g_assert_cmpuint(damage, <, full);
+
+  progress_renderer_free(r);
+  progress_frame_free(frame);
+}
+
+/**
+ * Benchmark: frames per second of timer_print, for each display combination
+ * (drawn to /dev/null, as on a terminal)
+ */
+static void test_perf_timer_print()
+{
+  ut_clock *clock = ut_clock_new();
+  gboolean quiet = ut_config.quiet, debug = ut_config.debug;
+  guint i, combo, frames = 20000;
+  gint fd = open("/dev/null", O_WRONLY);
+
+  g_assert_cmpint(fd, >=, 0);
+  ut_config.quiet = FALSE;
+  ut_config.debug = FALSE;
+
+  for (combo = 0; combo < 8; combo++)
+  {
+    timer_display display = { .text = (combo & 1) != 0,
+                              .perc = (combo & 2) != 0,
+                              .bar = (combo & 4) != 0 };
+    ut_timer *ttimer = ut_timer_new_countdown(3600 * UT_NSEC_PER_SEC, NULL, NULL, NULL, test_context, clock, TIMER_PRECISION_MILLISECOND, &display);
+    gdouble elapsed;
+
+    // as a terminal would be, whatever the test output is
+    progress_renderer_free(ttimer->renderer);
+    ttimer->renderer = progress_renderer_new(-1);
+    ttimer->renderer->fd = fd;
+
+    g_test_timer_start();
+    for (i = 0; i < frames; i++)
+      timer_print(ttimer);
+    elapsed = g_test_timer_elapsed();
+
+    g_test_maximized_result(frames / elapsed, "timer_print frames/sec (text=%d perc=%d bar=%d)",
+                            display.text ? 1 : 0, display.perc ? 1 : 0, display.bar ? 1 : 0);
+    ut_timer_destroy(ttimer);
+  }
+
+  ut_config.quiet = quiet;
+  ut_config.debug = debug;
+  close(fd);
+  ut_clock_destroy(clock);
+}
+
+/**
+ * Benchmark: nanoseconds per read of each clock source (see --clock)
+ */
+static void test_perf_clock_source_now()
+{
+  ut_clock_source_type type;
+  guint i, reads = 1000000;
+  gint64 sum = 0;
+
+  for (type = UT_CLOCK_SOURCE_MONOTONIC; type < UT_CLOCK_SOURCE_VIRTUAL; type++)
+  {
+    ut_clock_source *s = ut_clock_source_new(type);
+    gdouble elapsed;
+
+    if (s->type != type)
+    {
+      g_test_message("%s clock not available", ut_clock_source_type_to_string(type));
+      ut_clock_source_free(s);
+      continue;
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < reads; i++)
+      sum += ut_clock_source_now(s);
+    elapsed = g_test_timer_elapsed();
+
+    g_test_minimized_result(elapsed * 1e9 / reads, "ns per read (%s clock)",
+                            ut_clock_source_type_to_string(type));
+    ut_clock_source_free(s);
+  }
+
+  g_assert_cmpint(sum, !=, 0);
+}
+
+/**
+ * Benchmark: patterns parsed per second by ut_parse_time_pattern
+ */
+static void test_perf_parse_time_pattern()
+{
+  gchar *patterns[] = { "30s", "2m450ms", "9m7h30s80ms6d", "1d2h3m4s5ms6us7ns" };
+  guint i, p, count = 100000;
+  ut_duration duration;
+
+  for (p = 0; p < G_N_ELEMENTS(patterns); p++)
+  {
+    gdouble elapsed;
+
+    g_test_timer_start();
+    for (i = 0; i < count; i++)
+      ut_parse_time_pattern(patterns[p], &duration);
+    elapsed = g_test_timer_elapsed();
+
+    g_assert_cmpint(duration, >, 0);
+    g_test_maximized_result(count / elapsed, "ut_parse_time_pattern(\"%s\") patterns/sec", patterns[p]);
+  }
+}
+
+/**
+ * Benchmark: strings per second of timer_duration_to_string, per precision
+ */
+static void test_perf_timer_duration_to_string()
+{
+  timer_precision precisions[] = { TIMER_PRECISION_NANOSECOND,
+                                   TIMER_PRECISION_MICROSECOND,
+                                   TIMER_PRECISION_MILLISECOND,
+                                   TIMER_PRECISION_SECOND,
+                                   TIMER_PRECISION_MINUTE,
+                                   TIMER_PRECISION_HOUR };
+  const gchar *names[] = { "ns", "us", "ms", "s", "m", "h" };
+  guint i, p, count = 100000;
+
+  for (p = 0; p < G_N_ELEMENTS(precisions); p++)
+  {
+    gdouble elapsed;
+
+    g_test_timer_start();
+    for (i = 0; i < count; i++)
+      g_free(timer_duration_to_string(i * 1234567891LL, precisions[p]));
+    elapsed = g_test_timer_elapsed();
+
+    g_test_maximized_result(count / elapsed, "timer_duration_to_string (%s) strings/sec", names[p]);
+  }
+}
+
+/**
+ * Benchmark: bars per second of get_progress_bar, per width
+ */
+static void test_perf_get_progress_bar()
+{
+  gushort widths[] = { 10, 40, 80, 200 };
+  guint i, w, count = 100000;
+
+  for (w = 0; w < G_N_ELEMENTS(widths); w++)
+  {
+    gdouble elapsed;
+
+    g_test_timer_start();
+    for (i = 0; i < count; i++)
+      g_free(get_progress_bar(i % 101, widths[w], i & 1));
+    elapsed = g_test_timer_elapsed();
+
+    g_test_maximized_result(count / elapsed, "get_progress_bar (width %u) bars/sec", widths[w]);
+  }
+}
+
+/**
+ * Benchmark: cost of ut_timer_get_progress_percent
+ */
+static void test_perf_timer_get_progress_percent()
+{
+  ut_clock *clock = ut_clock_new();
+  ut_timer *ttimer = ut_timer_new_timer(3600 * UT_NSEC_PER_SEC, NULL, NULL, NULL, test_context, clock, TIMER_PRECISION_DEFAULT, NULL);
+  guint i, count = 1000000;
+  gint sum = 0;
+  gdouble elapsed;
+
+  g_test_timer_start();
+  for (i = 0; i < count; i++)
+    sum += ut_timer_get_progress_percent(ttimer);
+  elapsed = g_test_timer_elapsed();
+
+  g_assert_cmpint(sum, >=, 0);
+  g_test_minimized_result(elapsed * 1e9 / count, "ut_timer_get_progress_percent ns/call");
+
+  ut_timer_destroy(ttimer);
+  ut_clock_destroy(clock);
+}
+
 /**
  * Main tests' Main()
  * Starts the main testing units
@@ -570,7 +2137,10 @@ gint main(gint argc, gchar *argv[])
   ut_config.debug = g_test_verbose();
   ut_config.quiet = g_test_quiet() || !g_test_verbose();
 
-  setup_log_handler();
+  test_context = ut_context_new(NULL);
+  ut_context_set_quiet(test_context, ut_config.quiet);
+  ut_config.context = test_context;
+  setup_log_handler(&ut_config);
 
   // hook up the test functions
   g_test_add_func("/Utils/Suffix/Test1", test_suffix1);
@@ -579,19 +2149,33 @@ gint main(gint argc, gchar *argv[])
   g_test_add_func("/General/TimerCreation/Stopwatch", test_creation_stopwatch);
   g_test_add_func("/General/TimerCreation/Countdown", test_creation_countdown);
   g_test_add_func("/General/TimerDuration/Test1", test_timer_duration1);
-
-  g_test_add_func("/General/Functions/timer_sec_msec_to_string", test_timer_sec_msec_to_string);
-  g_test_add_func("/General/Functions/timer_add_seconds", test_timer_add_seconds);
-  g_test_add_func("/General/Functions/timer_timer_add_milliseconds", test_timer_add_milliseconds);
+  g_test_add_func("/General/TimerDuration/Precise", test_timer_precise);
+  g_test_add_func("/General/TimerDuration/Pause", test_timer_pause);
+  g_test_add_func("/General/TimerDuration/Start", test_timer_start);
+  g_test_add_func("/General/TimerDuration/Boottime", test_timer_boottime);
+  g_test_add_func("/General/TimerDuration/Until", test_timer_until);
+  g_test_add_func("/General/TimerDuration/Many", test_timer_many);
+  g_test_add_func("/General/TimerDuration/Threads", test_timer_threads);
+  g_test_add_func("/General/TimerDuration/Batch", test_batch);
+
+  g_test_add_func("/General/Functions/timer_duration_to_string", test_timer_duration_to_string);
+  g_test_add_func("/General/Functions/timer_add_time", test_timer_add_time);
+  g_test_add_func("/General/Functions/parse_until_pattern", test_parse_until_pattern);
+  g_test_add_func("/General/Functions/ut_clock", test_clock);
+  g_test_add_func("/General/Functions/ut_clock_threads", test_clock_threads);
+  g_test_add_func("/General/Functions/ut_clock_sources", test_clock_sources);
+  g_test_add_func("/General/Functions/signal_source", test_signal_source);
   g_test_add_func("/General/Functions/timer_timer_get_progress_percent1", test_timer_get_progress_percent_1);
   g_test_add_func("/General/Functions/timer_timer_get_progress_percent2", test_timer_get_progress_percent_2);
   g_test_add_func("/General/Functions/timer_timer_get_progress_percent3", test_timer_get_progress_percent_3);
   g_test_add_func("/General/Functions/timer_timer_get_progress_percent4", test_timer_get_progress_percent_4);
   g_test_add_func("/General/Functions/timer_timer_get_progress_percent5", test_timer_get_progress_percent_5);
+  g_test_add_func("/General/Functions/timer_timer_get_progress_percent6", test_timer_get_progress_percent_6);
 
   if (g_test_slow())
   {
-    g_test_add_func("/General/Functions/timer_timer_get_progress_percent6", test_timer_get_progress_percent_6);
+    g_test_add_func("/Accuracy/sleep", test_accuracy_sleep);
+    g_test_add_func("/Accuracy/spin", test_accuracy_spin);
   }
 
   g_test_add_func("/General/Functions/timer_get_progress_bar1", test_get_progress_bar);
@@ -599,6 +2183,27 @@ gint main(gint argc, gchar *argv[])
   g_test_add_func("/General/Functions/timer_get_progress_bar3", test_get_progress_bar3);
   g_test_add_func("/General/Functions/timer_get_progress_bar4", test_get_progress_bar4);
   g_test_add_func("/General/Functions/timer_get_progress_bar_width", test_get_progress_bar_width);
+  g_test_add_func("/General/Functions/timer_build_frame", test_timer_build_frame);
+#ifdef TEST_COUNT_ALLOCATIONS
+  g_test_add_func("/General/Functions/timer_build_frame_allocations", test_timer_build_frame_allocations);
+#endif
+  g_test_add_func("/General/Functions/progress_renderer", test_progress_renderer);
+  g_test_add_func("/General/Functions/timer_get_next_change", test_timer_get_next_change);
+  g_test_add_func("/General/Functions/timer_build_record", test_timer_build_record);
+  g_test_add_func("/General/Functions/stats_histogram", test_stats_histogram);
+  g_test_add_func("/General/Functions/wheel", test_wheel);
+  g_test_add_func("/General/Functions/timer_table", test_timer_table);
+
+  if (g_test_perf())
+  {
+    g_test_add_func("/Perf/progress_renderer_bytes", test_perf_progress_renderer_bytes);
+    g_test_add_func("/Perf/timer_print", test_perf_timer_print);
+    g_test_add_func("/Perf/clock_source_now", test_perf_clock_source_now);
+    g_test_add_func("/Perf/ut_parse_time_pattern", test_perf_parse_time_pattern);
+    g_test_add_func("/Perf/timer_duration_to_string", test_perf_timer_duration_to_string);
+    g_test_add_func("/Perf/get_progress_bar", test_perf_get_progress_bar);
+    g_test_add_func("/Perf/ut_timer_get_progress_percent", test_perf_timer_get_progress_percent);
+  }
 
   // run tests from the suite
   return g_test_run();
@@ -0,0 +1,461 @@
+/*
+ *  tests/timerbench.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+
+#ifdef HAVE_MALLINFO2
+  #include <malloc.h>
+#endif
+
+#include "../clock.h"
+#include "../deadline.h"
+#include "../wheel.h"
+#include "../stats.h"
+
+/*
+ * timerbench: how the timer schedulers scale with the number of timers.
+ *
+ * The wheel backend is what the timers of utimer run on: its timers live
+ * in a ut_timer_table, so it holds up to TIMER_TABLE_MAX_TIMERS of them and
+ * is skipped above that.
+ *
+ * For each size, synthetic timers are inserted with random deadlines
+ * spread over a window, half of them are cancelled, then the others are
+ * expired as their deadline passes on CLOCK_MONOTONIC. Each backend
+ * reports the rate of each operation, the memory each timer costs
+ * (what was allocated for the timers and the backend, divided by the
+ * number of timers) and how late the timers expired, which grows once a backend cannot
+ * keep up with the expiry rate.
+ */
+
+/* A synthetic timer: what a ut_timer needs from its scheduler, a length and
+ * the deadline it was armed with, plus the handle of the backend. */
+typedef struct
+{
+  ut_duration length;
+  gint64 deadline; // from the start of the run
+  union
+  {
+    guint index; // in a heap
+    GSequenceIter *iter;
+    ut_timer_handle expiry; // in the table of the wheel
+  } handle;
+} bench_timer;
+
+typedef struct
+{
+  const gchar *name;
+  guint max_count; // 0 if there is no limit
+  gpointer (*create)(guint count);
+  void (*destroy)(gpointer scheduler);
+  void (*insert)(gpointer scheduler, bench_timer *t);
+  void (*cancel)(gpointer scheduler, bench_timer *t);
+  void (*expire)(gpointer scheduler, gint64 now); // calls bench_expired()
+} bench_backend;
+
+static ut_clock_source *bench_clock = NULL;
+static gint64 bench_start = 0;
+static guint64 bench_expired_count = 0;
+static stats_histogram bench_lateness;
+
+static inline gint64 bench_now()
+{
+  return ut_clock_source_now(bench_clock) - bench_start;
+}
+
+static void bench_expired(bench_timer *t)
+{
+  bench_expired_count++;
+  stats_histogram_record(&bench_lateness, bench_now() - t->deadline);
+}
+
+/* == d-ary min-heaps of timers, ordered by deadline == */
+
+typedef struct
+{
+  guint arity;
+  guint size;
+  bench_timer **timers;
+} bench_heap;
+
+static inline void bench_heap_put(bench_heap *h, guint i, bench_timer *t)
+{
+  h->timers[i] = t;
+  t->handle.index = i;
+}
+
+static void bench_heap_up(bench_heap *h, guint i)
+{
+  bench_timer *t = h->timers[i];
+
+  while (i > 0)
+  {
+    guint parent = (i - 1) / h->arity;
+
+    if (h->timers[parent]->deadline <= t->deadline)
+      break;
+    bench_heap_put(h, i, h->timers[parent]);
+    i = parent;
+  }
+  bench_heap_put(h, i, t);
+}
+
+static void bench_heap_down(bench_heap *h, guint i)
+{
+  bench_timer *t = h->timers[i];
+
+  for (;;)
+  {
+    guint first = i * h->arity + 1, last = MIN(first + h->arity, h->size);
+    guint child, min = i;
+    gint64 deadline = t->deadline;
+
+    for (child = first; child < last; child++)
+    {
+      if (h->timers[child]->deadline < deadline)
+      {
+        min = child;
+        deadline = h->timers[child]->deadline;
+      }
+    }
+    if (min == i)
+      break;
+    bench_heap_put(h, i, h->timers[min]);
+    i = min;
+  }
+  bench_heap_put(h, i, t);
+}
+
+static gpointer bench_heap_create(guint count, guint arity)
+{
+  bench_heap *h = g_new0(bench_heap, 1);
+
+  h->arity = arity;
+  h->timers = g_new(bench_timer*, count);
+  return h;
+}
+
+static gpointer bench_heap2_create(guint count)
+{
+  return bench_heap_create(count, 2);
+}
+
+static gpointer bench_heap4_create(guint count)
+{
+  return bench_heap_create(count, 4);
+}
+
+static void bench_heap_destroy(gpointer scheduler)
+{
+  bench_heap *h = scheduler;
+
+  g_free(h->timers);
+  g_free(h);
+}
+
+static void bench_heap_insert(gpointer scheduler, bench_timer *t)
+{
+  bench_heap *h = scheduler;
+
+  bench_heap_put(h, h->size++, t);
+  bench_heap_up(h, h->size - 1);
+}
+
+static void bench_heap_cancel(gpointer scheduler, bench_timer *t)
+{
+  bench_heap *h = scheduler;
+  guint i = t->handle.index;
+
+  if (--h->size == i)
+    return;
+
+  // the last timer takes its place, and may have to go either way
+  bench_heap_put(h, i, h->timers[h->size]);
+  if (i > 0 && h->timers[(i - 1) / h->arity]->deadline > h->timers[i]->deadline)
+    bench_heap_up(h, i);
+  else
+    bench_heap_down(h, i);
+}
+
+static void bench_heap_expire(gpointer scheduler, gint64 now)
+{
+  bench_heap *h = scheduler;
+
+  while (h->size > 0 && h->timers[0]->deadline <= now)
+  {
+    bench_timer *t = h->timers[0];
+
+    bench_heap_cancel(h, t);
+    bench_expired(t);
+  }
+}
+
+/* == the timing wheel of utimer (see wheel.c) == */
+
+static void bench_wheel_expired(ut_timer_table *table, ut_timer_handle handle, gpointer data)
+{
+  bench_expired(timer_table_get_data(table, handle));
+  // as a ut_timer does, making room for the next ones
+  wheel_remove_timer(data, handle);
+}
+
+static gpointer bench_wheel_create(guint count)
+{
+  // no clock source: the wheel only runs when asked to, from time 0
+  return wheel_new(NULL, NULL);
+}
+
+static void bench_wheel_destroy(gpointer scheduler)
+{
+  wheel_free(scheduler);
+}
+
+static void bench_wheel_insert(gpointer scheduler, bench_timer *t)
+{
+  t->handle.expiry = wheel_add_timer(scheduler, bench_wheel_expired, scheduler, t);
+  wheel_arm(scheduler, t->handle.expiry, t->deadline);
+}
+
+static void bench_wheel_cancel(gpointer scheduler, bench_timer *t)
+{
+  wheel_remove_timer(scheduler, t->handle.expiry);
+}
+
+static void bench_wheel_expire(gpointer scheduler, gint64 now)
+{
+  wheel_run(scheduler, now);
+}
+
+/* == a GSequence (balanced tree) sorted by deadline == */
+
+static gint bench_sequence_compare(gconstpointer a, gconstpointer b, gpointer data)
+{
+  const bench_timer *ta = a, *tb = b;
+
+  if (ta->deadline != tb->deadline)
+    return ta->deadline < tb->deadline ? -1 : 1;
+  return (ta < tb) ? -1 : (ta > tb);
+}
+
+static gpointer bench_sequence_create(guint count)
+{
+  return g_sequence_new(NULL);
+}
+
+static void bench_sequence_destroy(gpointer scheduler)
+{
+  g_sequence_free(scheduler);
+}
+
+static void bench_sequence_insert(gpointer scheduler, bench_timer *t)
+{
+  t->handle.iter = g_sequence_insert_sorted(scheduler, t, bench_sequence_compare, NULL);
+}
+
+static void bench_sequence_cancel(gpointer scheduler, bench_timer *t)
+{
+  g_sequence_remove(t->handle.iter);
+}
+
+static void bench_sequence_expire(gpointer scheduler, gint64 now)
+{
+  GSequenceIter *first;
+
+  while (!g_sequence_iter_is_end(first = g_sequence_get_begin_iter(scheduler)))
+  {
+    bench_timer *t = g_sequence_get(first);
+
+    if (t->deadline > now)
+      break;
+    g_sequence_remove(first);
+    bench_expired(t);
+  }
+}
+
+static const bench_backend bench_backends[] = {
+  { "heap2", 0, bench_heap2_create, bench_heap_destroy,
+    bench_heap_insert, bench_heap_cancel, bench_heap_expire },
+  { "heap4", 0, bench_heap4_create, bench_heap_destroy,
+    bench_heap_insert, bench_heap_cancel, bench_heap_expire },
+  { "wheel", TIMER_TABLE_MAX_TIMERS, bench_wheel_create, bench_wheel_destroy,
+    bench_wheel_insert, bench_wheel_cancel, bench_wheel_expire },
+  { "gsequence", 0, bench_sequence_create, bench_sequence_destroy,
+    bench_sequence_insert, bench_sequence_cancel, bench_sequence_expire }
+};
+
+/* Returns how many bytes are allocated on the heap, or without mallinfo2()
+ * the resident set size of the process (freed memory that malloc keeps for
+ * later then makes the smaller sizes look free). 0 if unknown. */
+static gsize bench_allocated_bytes()
+{
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 info = mallinfo2();
+
+  return info.uordblks + info.hblkhd;
+#else
+  gsize size = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+
+  if (!statm)
+    return 0;
+  if (fscanf(statm, "%zu %zu", &size, &resident) != 2)
+    resident = 0;
+  fclose(statm);
+  return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static inline gdouble bench_rate(guint64 ops, ut_duration time)
+{
+  return time > 0 ? (gdouble) ops * UT_NSEC_PER_SEC / time : 0;
+}
+
+/* Inserts, cancels and expires count timers with the given backend, and
+ * prints one line of results. */
+static void bench_run(const bench_backend *b, guint count, ut_duration window, GRand *rand)
+{
+  bench_timer *timers;
+  gpointer scheduler;
+  gsize allocated;
+  gint64 begin, busy = 0;
+  ut_duration insert_time, cancel_time;
+  guint i, cancelled = 0;
+
+  allocated = bench_allocated_bytes();
+  timers = g_new(bench_timer, count);
+  scheduler = b->create(count);
+
+  /* the deadlines start after the insertions and cancellations, estimated
+   * at a generous 1 us per timer */
+  bench_start = ut_clock_source_now(bench_clock);
+  for (i = 0; i < count; i++)
+  {
+    timers[i].length = (ut_duration) count * UT_NSEC_PER_USEC
+                       + (ut_duration) (g_rand_double(rand) * window);
+    timers[i].deadline = timers[i].length;
+  }
+
+  begin = bench_now();
+  for (i = 0; i < count; i++)
+    b->insert(scheduler, &timers[i]);
+  insert_time = bench_now() - begin;
+  allocated = bench_allocated_bytes() - allocated;
+
+  begin = bench_now();
+  for (i = 1; i < count; i += 2, cancelled++)
+    b->cancel(scheduler, &timers[i]);
+  cancel_time = bench_now() - begin;
+
+  bench_expired_count = 0;
+  stats_histogram_init(&bench_lateness);
+  while (bench_expired_count < count - cancelled)
+  {
+    guint64 expired = bench_expired_count;
+
+    begin = bench_now();
+    b->expire(scheduler, begin);
+    if (bench_expired_count > expired)
+      busy += bench_now() - begin;
+  }
+
+  g_print("%-10s %9u %12.0f %12.0f %12.0f %10.1f %10.1f %10.1f %10.1f\n",
+          b->name, count,
+          bench_rate(count, insert_time),
+          bench_rate(cancelled, cancel_time),
+          bench_rate(bench_expired_count, busy),
+          (gdouble) allocated / count,
+          stats_histogram_percentile(&bench_lateness, 50) / 1000.0,
+          stats_histogram_percentile(&bench_lateness, 99) / 1000.0,
+          bench_lateness.max / 1000.0);
+
+  b->destroy(scheduler);
+  g_free(timers);
+}
+
+gint main(gint argc, gchar *argv[])
+{
+  gint min = 3, max = 7, window_ms = 1000, seed = 42, n;
+  gchar *backend = NULL;
+  GError *error = NULL;
+  GOptionContext *context;
+  GRand *rand;
+  guint i;
+  GOptionEntry entries[] = {
+    { "min", 0, 0, G_OPTION_ARG_INT, &min, "smallest size, as a power of ten (default 3)", "N" },
+    { "max", 0, 0, G_OPTION_ARG_INT, &max, "largest size, as a power of ten (default 7)", "N" },
+    { "backend", 'b', 0, G_OPTION_ARG_STRING, &backend, "only run this backend: heap2, heap4, wheel or gsequence", "NAME" },
+    { "window", 'w', 0, G_OPTION_ARG_INT, &window_ms, "spread the deadlines over MS milliseconds (default 1000)", "MS" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "seed of the deadlines (default 42)", "SEED" },
+    { NULL }
+  };
+
+  context = g_option_context_new("- compare the timer schedulers");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (min < 0 || max > 9 || min > max || window_ms < 0)
+  {
+    g_printerr("invalid sizes or window\n");
+    return EXIT_FAILURE;
+  }
+
+  bench_clock = ut_clock_source_get_default();
+  rand = g_rand_new_with_seed(seed);
+
+  g_print("%-10s %9s %12s %12s %12s %10s %10s %10s %10s\n", "backend", "timers",
+          "insert/s", "cancel/s", "expire/s", "bytes", "p50 us", "p99 us", "max us");
+
+  for (n = min; n <= max; n++)
+  {
+    guint count = 1;
+
+    for (i = 0; i < (guint) n; i++)
+      count *= 10;
+
+    for (i = 0; i < G_N_ELEMENTS(bench_backends); i++)
+    {
+      if (backend && g_strcmp0(backend, bench_backends[i].name) != 0)
+        continue;
+      if (bench_backends[i].max_count && count > bench_backends[i].max_count)
+        continue;
+      g_rand_set_seed(rand, seed);
+      bench_run(&bench_backends[i], count, window_ms * UT_NSEC_PER_MSEC, rand);
+    }
+  }
+
+  g_rand_free(rand);
+  g_free(backend);
+  return EXIT_SUCCESS;
+}
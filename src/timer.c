@@ -26,13 +26,18 @@
   #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
-#include "utimer.h"
 #include "timer.h"
+#include "deadline.h"
+#include "wheel.h"
 
 static timer_display timer_default_display = {
                                               .bar  = 0,
@@ -40,223 +45,731 @@ static timer_display timer_default_display = {
                                               .perc = 1
 };
 
-static GTimeValDiff timer_get_diff(const ut_timer *timer)
+/** Returns the time elapsed on the given ut_timer.
+ * This only reads the clock of the timer, so it may be called from any
+ * thread, even while the timer is paused or resumed.
+ * @param t a pointer to a ut_timer
+ */
+ut_duration ut_timer_get_elapsed(const ut_timer *t)
 {
-  GTimeValDiff diff;
-  gulong tmpul;
+  g_assert(t && t->clock);
 
-  g_assert(timer && timer->gtimer);
+  return ut_clock_elapsed(t->clock);
+}
 
-  diff.tv_sec = g_timer_elapsed(timer->gtimer, &tmpul);
-  diff.tv_usec = (guint) tmpul;
+/** Returns the time left before the given ut_timer expires.
+ * The result is 0 if the timer already reached its length.
+ * @param t a pointer to a ut_timer
+ */
+ut_duration ut_timer_get_remaining(const ut_timer *t)
+{
+  return MAX(t->length - ut_timer_get_elapsed(t), 0);
+}
+
+/** Returns TRUE if the given ut_timer is paused (see ut_timer_pause()).
+ * This reads the clock of the timer, so it may be called from any thread.
+ * @param t a pointer to a ut_timer
+ */
+gboolean ut_timer_is_paused(const ut_timer *t)
+{
+  g_assert(t);
 
-  g_debug("timer_get_diff: %u.%06u", diff.tv_sec, diff.tv_usec);
-  return diff;
+  return !ut_clock_is_active(t->clock);
 }
 
-static GTimeValDiff countdown_get_diff(ut_timer *t)
+/** Returns TRUE once the given ut_timer expired and called its success
+ * callback. Stopwatches never expire.
+ * @param t a pointer to a ut_timer
+ */
+gboolean ut_timer_has_expired(const ut_timer *t)
 {
-  GTimeValDiff diff;
-  gulong tmpul;
+  g_assert(t);
 
-  /* diff = elapsed time */
-  diff.tv_sec = g_timer_elapsed(t->gtimer, &tmpul);
-  diff.tv_usec = tmpul;
+  return t->overshoot >= 0;
+}
 
-  /* ------- We need: diff = given time - elapsed time ------- */
+/* The functions below work on one reading of the clock (elapsed), so that
+ * what a frame or a record shows is consistent, and the clock is only read
+ * once for it. */
 
-  diff.tv_sec = t->seconds - diff.tv_sec;
+static inline ut_duration timer_remaining_at(const ut_timer *t, ut_duration elapsed)
+{
+  return MAX(t->length - elapsed, 0);
+}
 
-  /* If there are more than one second, and usec < tv_usec */
-  if (diff.tv_sec > 0 && t->mseconds * 1000 < diff.tv_usec)
-  {
-    diff.tv_sec--;
-    diff.tv_usec = 1000000 - (diff.tv_usec - t->mseconds * 1000);
-  }
-  else if (t->mseconds * 1000 >= diff.tv_usec) /* usec >= tv_usec, normal substraction */
-  {
-    diff.tv_usec = t->mseconds * 1000 - diff.tv_usec;
-  }
-  else /* if 0 seconds and usec < tv_usec, we are already late! */
-  {
-    diff.tv_usec = 0;
-  }
+static gint8 timer_percent_at(const ut_timer *t, ut_duration elapsed)
+{
+  if (G_UNLIKELY(t->length == 0))
+    return 100;
 
-  g_debug("countdown_get_diff: %u.%06u", diff.tv_sec, diff.tv_usec);
-  return diff;
+  elapsed = CLAMP(elapsed, 0, t->length);
+  return (gint8) round((gdouble) elapsed * 100 / (gdouble) t->length);
 }
 
-/** Prints the remaining time
- * This function prints the remaining time to STDOUT with the format specified
- * by the timer_display in the given ut_timer (t->display).
+/** Records a wake-up of the given ut_timer.
+ * The lateness is the time between the deadline that woke it up and now.
+ * Nothing is done when the stats are not enabled, or when nothing actually
+ * woke up (a direct call of a source callback).
  * @param t a pointer to a ut_timer
+ * @param fired the deadline that was reached, or DEADLINE_NONE
  */
-gboolean timer_print(ut_timer *t)
+static void timer_record_wakeup(ut_timer *t, gint64 fired)
+{
+  if (G_LIKELY(!t->stats))
+    return;
+
+  if (fired == DEADLINE_NONE)
+    return;
+
+  t->stats->wakeups++;
+  stats_histogram_record(&t->stats->lateness, ut_clock_source_now(t->clock->source) - fired);
+}
+
+/** Builds the line to display for the given ut_timer into frame.
+ * The frame is laid out for a terminal of cols columns, with the format
+ * specified by the timer_display in the given ut_timer (t->display). Parts
+ * that do not fit are left out. Once the frame has grown to the terminal
+ * width, this does not allocate any memory.
+ * @param t a pointer to a ut_timer
+ * @param frame the frame to fill
+ * @param cols the width of the terminal, 0 if unknown
+ * @return FALSE if there is no room to display anything
+ */
+gboolean timer_build_frame(const ut_timer *t, progress_frame *frame, gushort cols)
 {
-  gushort orig_width = get_terminal_width();
+  if (cols == 0)
+    cols = TIMER_DEFAULT_COLS;
+
   // substract 2 to cols: one for the ending space, one extra in case user hits a key
-  gushort width_left = orig_width - 2;
+  gushort width_left = cols - 2;
 
   // if there is not even 2 cols to use, do nothing
-  if (width_left < 2)
-    return TRUE;
+  if (cols < 4)
+    return FALSE;
 
-  GTimeValDiff delta;
-  gchar *main_str = g_strdup(""),
-        *perc_str = NULL,
-        *text_str = NULL,
-        *bar_str = NULL;
-  gint8 perc = timer_get_progress_percent(t);
+  ut_duration delta, elapsed = ut_timer_get_elapsed(t);
+  gchar time_text[TIMER_TEXT_MAX],
+        text_str[TIMER_TEXT_MAX],
+        perc_str[16];
+  gsize text_len = 0, perc_len = 0;
+  gint8 perc = timer_percent_at(t, elapsed);
   g_assert_cmpint(perc, >=, 0);
 
+  progress_frame_reset(frame, width_left);
+
   if (t->mode == TIMER_MODE_COUNTDOWN)
-    delta = countdown_get_diff(t);
+    delta = timer_remaining_at(t, elapsed);
   else
-    delta = timer_get_diff(t);
+    delta = elapsed;
 
   if (perc < 0)
     perc = 0;
 
-
   if (t->display.text)
   {
-    gchar *time_text = timer_sec_msec_to_string(delta.tv_sec, delta.tv_usec / 1000, t->precision);
+    timer_format_duration(time_text, sizeof(time_text), delta, t->precision);
     if (t->mode == TIMER_MODE_COUNTDOWN)
-      text_str = g_strdup_printf(_("Time Remaining: %s"), time_text);
+      g_snprintf(text_str, sizeof(text_str), _("Time Remaining: %s"), time_text);
     else
-      text_str = g_strdup_printf(_("Elapsed Time: %s"), time_text);
-    g_free(time_text);
+      g_snprintf(text_str, sizeof(text_str), _("Elapsed Time: %s"), time_text);
+    text_len = strlen(text_str);
   }
 
   if (t->display.perc)
-    perc_str = g_strdup_printf(" (%i%%)", perc);
+    perc_len = g_snprintf(perc_str, sizeof(perc_str), " (%i%%)", perc);
 
-  /* Print to STDOUT depending on width left */
+  /* Fill the frame depending on width left */
 
   // see if the Time text fits
-  if (t->display.text && width_left >= strlen(text_str)+1)
+  if (t->display.text && width_left >= text_len+1)
   {
-    gchar *tmp = main_str;
-    main_str = g_strconcat(main_str, text_str, " ", NULL);
-    g_free(tmp);
-    width_left -= strlen(text_str)+1;
+    progress_frame_append(frame, text_str, text_len);
+    progress_frame_append(frame, " ", 1);
+    width_left -= text_len+1;
   }
 
   // see if the percentage fits (when there is no bar)
-  if (t->display.perc && width_left >= strlen(perc_str)+1)
+  if (t->display.perc && width_left >= perc_len+1)
   {
-    gchar *tmp = main_str;
-    main_str = g_strconcat(main_str, perc_str, " ", NULL);
-    g_free(tmp);
-    width_left -= strlen(perc_str)+1;
+    progress_frame_append(frame, perc_str, perc_len);
+    progress_frame_append(frame, " ", 1);
+    width_left -= perc_len+1;
   }
 
   // see if the bar fits
   // Actually it is dynamic, so we only check if there's at least 3 chars available)
   if (t->display.bar && width_left >= 3)
   {
-    bar_str = get_progress_bar(perc, width_left-1, (t->mode != TIMER_MODE_COUNTDOWN));
-    gchar *tmp = main_str;
-    main_str = g_strconcat(main_str, bar_str, " ", NULL);
-    g_free(tmp);
-    width_left -= strlen(bar_str)+1;
+    progress_frame_append_bar(frame, perc, width_left-1, (t->mode != TIMER_MODE_COUNTDOWN));
+    progress_frame_append(frame, " ", 1);
   }
 
-  g_message("\r%s ",main_str); /* trailing space needed! */
+  return TRUE;
+}
 
-  g_free(main_str);
-  g_free(perc_str);
-  g_free(text_str);
-  g_free(bar_str);
+/** Prints the remaining time
+ * This function prints the remaining time to STDOUT with the format specified
+ * by the timer_display in the given ut_timer (t->display). The line is built
+ * in the reusable frame of the timer, and only the characters that changed
+ * since the previous frame are written to the terminal.
+ * @param t a pointer to a ut_timer
+ */
+gboolean timer_print(ut_timer *t)
+{
+  if (t->context->quiet)
+    return TRUE;
+
+  if (!timer_build_frame(t, t->frame, ut_context_get_cols(t->context)))
+    return TRUE;
+
+  // a resize or other messages may have messed up the line: redraw it all
+  if (t->context->redraw)
+  {
+    t->context->redraw = FALSE;
+    progress_renderer_invalidate(t->renderer);
+  }
+
+  if (!progress_renderer_draw(t->renderer, t->frame))
+    g_debug("%s: writing to the terminal failed", __FUNCTION__);
+
+  if (t->stats)
+    t->stats->frames++;
 
   return TRUE;
 }
 
-/** Sleeps for the given ut_timer time.
- * This function sleeps for the whole time of the given ut_timer or until
- * t->checkloop_thread_stop_with_error is set to false.
+/** Returns the length of one unit of the given precision.
+ */
+static ut_duration timer_precision_unit(timer_precision precision)
+{
+  switch (precision)
+  {
+    case TIMER_PRECISION_HOUR:
+      return 3600 * UT_NSEC_PER_SEC;
+    case TIMER_PRECISION_MINUTE:
+      return 60 * UT_NSEC_PER_SEC;
+    case TIMER_PRECISION_SECOND:
+      return UT_NSEC_PER_SEC;
+    case TIMER_PRECISION_MICROSECOND:
+      return UT_NSEC_PER_USEC;
+    case TIMER_PRECISION_NANOSECOND:
+      return 1;
+    default:
+      return UT_NSEC_PER_MSEC;
+  }
+}
+
+/** Returns the elapsed time at which the percentage will change next.
+ * This follows the rounding done by ut_timer_get_progress_percent().
+ * @return -1 if the percentage will not change anymore
+ */
+static ut_duration timer_get_next_percent(const ut_timer *t, ut_duration elapsed)
+{
+  gint8 perc = timer_percent_at(t, elapsed);
+  gint64 steps = 2 * perc + 1;
+
+  if (perc >= 100 || t->length == 0)
+    return -1;
+
+  // rounded: changes when 200 * elapsed >= (2 * perc + 1) * length
+  return MAX(t->length / 200 * steps + (t->length % 200 * steps + 199) / 200,
+             elapsed + 1);
+}
+
+/** Returns how long the displayed line of the given ut_timer stays the same.
+ * That is the time until the next unit of its precision is reached by the
+ * elapsed or remaining time, or until the next percentage step (which is
+ * also when the progress bar may change), depending on what is displayed.
  * @param t a pointer to a ut_timer
+ * @return -1 if the line will not change (e.g. if the timer is paused)
  */
-gboolean timer_check_loop(ut_timer *t)
+ut_duration timer_get_next_change(const ut_timer *t)
 {
-  GTimeValDiff elapsed;
-  guint wanted_usec = t->mseconds * 1000;
-  guint wanted_sec = t->seconds;
+  ut_duration unit = timer_precision_unit(t->precision);
+  ut_duration next = UT_DURATION_MAX;
+  ut_duration elapsed = ut_timer_get_elapsed(t);
 
-  g_assert(TIMER_CHECK_RATE_MSEC < 1000);
+  if (ut_timer_is_paused(t))
+    return -1;
 
-  while (!t->checkloop_thread_stop_with_error)
+  if (t->display.text)
   {
-    elapsed = timer_get_diff(t);
-
-    if (G_LIKELY(elapsed.tv_sec < wanted_sec || elapsed.tv_sec == wanted_sec && elapsed.tv_usec < wanted_usec))
+    if (t->mode == TIMER_MODE_COUNTDOWN)
     {
-
-      guint remaining_sec = wanted_sec - elapsed.tv_sec;
-      guint remaining_usec = 0;
-
-      /* -If- more than 1 second remaining, and elapsed.usec > wanted_usec */
-      if (remaining_sec >= 1 && elapsed.tv_usec > wanted_usec)
-      {
-        /* (wanted_usec - elapsed.tv_usec)  would be negative,
-         * so we need to do this (this is like a decomposed substraction):
-         */
-        remaining_sec--;
-        remaining_usec = 1000000 - (elapsed.tv_usec - wanted_usec);
-      }
-      else if (wanted_usec >= elapsed.tv_usec)
-      {
-        /* -If- wanted_usec >= elapsed.usec, normal substraction
-         * (we explicetly don't care about remaining_sec)
-         */
-
-        remaining_usec = wanted_usec - elapsed.tv_usec;
-      }
-      else /* if 0 seconds and usec < tv_usec, we are already late! */
-      {
-        remaining_usec = 0;
-      }
-
-      /* if less than a second is remaining and rate is too big */
-      if (G_UNLIKELY(remaining_sec == 0 && TIMER_CHECK_RATE_MSEC * 1000 > remaining_usec))
-      {
-        g_debug("sleeping for remaining: %u us (< %u us)", remaining_usec, TIMER_CHECK_RATE_MSEC * 1000);
-        g_usleep(remaining_usec); /* we sleep for the remaining part */
-      }
-      else
-      {
-        g_debug("sleeping for normal rate: %u us", TIMER_CHECK_RATE_MSEC * 1000);
-        g_usleep(TIMER_CHECK_RATE_MSEC * 1000); /* otherwise we sleep another 'rate' */
-      }
+      ut_duration remaining = timer_remaining_at(t, elapsed);
+      if (remaining > 0)
+        next = remaining % unit;
     }
     else
-      break;
+      next = unit - elapsed % unit;
+  }
+
+  if ((t->display.perc || t->display.bar) && t->mode != TIMER_MODE_STOPWATCH)
+  {
+    ut_duration perc_at = timer_get_next_percent(t, elapsed);
+    if (perc_at >= 0)
+      next = MIN(next, perc_at - elapsed);
   }
 
-  /* Time's up! request to stop updating, and returns */
-  if (t->timer_print_source_id)
-    g_source_remove(t->timer_print_source_id);
+  return (next == UT_DURATION_MAX ? -1 : MAX(next, 0));
+}
+
+/** Arms the print source for the next time the displayed line changes.
+ * Frames are never closer than TIMER_PRINT_MIN_INTERVAL_MSEC.
+ * @param t a pointer to a ut_timer
+ */
+static void timer_arm_print(ut_timer *t)
+{
+  ut_duration next = timer_get_next_change(t);
 
-  if (t->checkloop_thread_stop_with_error) /* if we quitted the loop with an error */
+  if (next < 0)
   {
-    g_debug("%s: thread stopped with error", __FUNCTION__);
-    if (t->error_callback)
-      t->error_callback();
-    return FALSE;
+    deadline_source_set(t->print_source, DEADLINE_NONE);
+    return;
   }
 
-  g_debug("%s: thread stopped with success", __FUNCTION__);
-  if (t->success_callback)
-    t->success_callback();
+  next = MAX(next, TIMER_PRINT_MIN_INTERVAL_MSEC * UT_NSEC_PER_MSEC);
+  deadline_source_set(t->print_source, ut_clock_source_now(t->clock->source) + next);
+}
+
+static gboolean timer_print_and_rearm(ut_timer *t)
+{
+  timer_record_wakeup(t, deadline_source_get_fired(t->print_source));
+  timer_print(t);
+  timer_arm_print(t);
+  return TRUE;
+}
+
+/** Prints the given ut_timer now, and every time the displayed line changes.
+ * Instead of refreshing at a fixed rate, the print source sleeps until the
+ * displayed time or percentage changes (see timer_get_next_change()).
+ * @param t a pointer to a ut_timer
+ */
+void timer_start_print(ut_timer *t)
+{
+  g_assert(t);
+
+  if (t->print_source)
+    return;
+
+  t->print_source = deadline_source_new(t->clock->source);
+  g_source_set_callback(t->print_source, (GSourceFunc) timer_print_and_rearm, t, NULL);
+  g_source_attach(t->print_source, t->context->main_context);
+
+  timer_print_and_rearm(t);
+}
+
+/** Stops printing the given ut_timer (see timer_start_print()).
+ * @param t a pointer to a ut_timer
+ */
+void timer_stop_print(ut_timer *t)
+{
+  if (!t->print_source)
+    return;
+
+  g_source_destroy(t->print_source);
+  g_source_unref(t->print_source);
+  t->print_source = NULL;
+}
+
+/** Writes the current progress of the given ut_timer as one record into buf.
+ * The times are given in nanoseconds. Remaining time and percentage do not
+ * apply to stopwatches and are left out (see stream_format_record()).
+ * @param t a pointer to a ut_timer
+ * @return the length of the record line
+ */
+gsize timer_build_record(const ut_timer *t, gchar *buf, gsize size, stream_format format)
+{
+  stream_record record;
+  ut_duration elapsed = ut_timer_get_elapsed(t);
+
+  record.elapsed_ns = elapsed;
+  record.paused = ut_timer_is_paused(t);
+
+  if (t->mode == TIMER_MODE_STOPWATCH)
+  {
+    record.mode = "stopwatch";
+    record.remaining_ns = -1;
+    record.perc = -1;
+  }
+  else
+  {
+    record.mode = (t->mode == TIMER_MODE_COUNTDOWN ? "countdown" : "timer");
+    record.remaining_ns = timer_remaining_at(t, elapsed);
+    record.perc = MIN(timer_percent_at(t, elapsed), 100);
+  }
+
+  return stream_format_record(buf, size, format, &record);
+}
+
+/** Writes one record of the given ut_timer to STDOUT, with a single write().
+ */
+static void timer_write_record(ut_timer *t)
+{
+  gchar buf[STREAM_RECORD_MAX];
+  gsize len = timer_build_record(t, buf, sizeof(buf), t->format);
+
+  if (!stream_write(STDOUT_FILENO, buf, len))
+    g_debug("%s: writing the record failed", __FUNCTION__);
+  else if (t->stats)
+  {
+    t->stats->frames++;
+    t->stats->bytes_written += len;
+  }
+}
+
+static gboolean timer_stream_and_rearm(ut_timer *t)
+{
+  gint64 now = ut_clock_source_now(t->clock->source);
+
+  timer_record_wakeup(t, deadline_source_get_fired(t->stream_source));
+  timer_write_record(t);
+
+  // stay on the start + n * interval grid, skipping the ticks we missed
+  t->stream_next += t->stream_interval;
+  if (t->stream_next <= now)
+    t->stream_next += ((now - t->stream_next) / t->stream_interval + 1) * t->stream_interval;
+
+  deadline_source_set(t->stream_source, t->stream_next);
   return TRUE;
 }
 
+/** Writes the progress of the given ut_timer to STDOUT as a stream of records.
+ * One record (a full line, see stream_format_record()) is written right away,
+ * then every interval, whether the timer is paused or not. CSV and TSV
+ * streams start with a header line. This replaces timer_start_print() when
+ * the output is meant for another program.
+ * @param t a pointer to a ut_timer
+ * @param format the format of the records
+ * @param interval the time between two records
+ */
+void timer_start_stream(ut_timer *t, stream_format format, ut_duration interval)
+{
+  gchar buf[STREAM_RECORD_MAX];
+  gsize len;
+
+  g_assert(t && format != STREAM_FORMAT_NONE && interval > 0);
+
+  if (t->stream_source)
+    return;
+
+  t->format = format;
+  t->stream_interval = interval;
+
+  len = stream_format_header(buf, sizeof(buf), format);
+  if (len > 0 && !stream_write(STDOUT_FILENO, buf, len))
+    g_debug("%s: writing the header failed", __FUNCTION__);
+
+  t->stream_source = deadline_source_new(t->clock->source);
+  g_source_set_callback(t->stream_source, (GSourceFunc) timer_stream_and_rearm, t, NULL);
+  g_source_attach(t->stream_source, t->context->main_context);
+
+  t->stream_next = ut_clock_source_now(t->clock->source);
+  timer_stream_and_rearm(t);
+}
+
+/** Stops the stream of the given ut_timer (see timer_start_stream()).
+ * A last record is written, so that the stream always ends with the final
+ * state of the timer.
+ * @param t a pointer to a ut_timer
+ */
+void timer_stop_stream(ut_timer *t)
+{
+  if (!t->stream_source)
+    return;
+
+  g_source_destroy(t->stream_source);
+  g_source_unref(t->stream_source);
+  t->stream_source = NULL;
+
+  timer_write_record(t);
+}
+
+/** Arms the expiry timer for the time left on the given ut_timer.
+ * With a spin margin (see timer_set_spin()), it expires that much
+ * earlier and timer_expired() spins for the rest.
+ * @param t a pointer to a ut_timer
+ */
+static void timer_arm_expiry(ut_timer *t)
+{
+  ut_duration remaining = ut_timer_get_remaining(t);
+
+  g_debug("%s: expiring in %" G_GINT64_FORMAT " ns", __FUNCTION__, remaining);
+  wheel_arm(t->wheel, t->expiry,
+            duration_add(ut_clock_source_now(t->clock->source), MAX(remaining - t->spin, 0)));
+}
+
+/** Sets the length of the given countdown so that it ends at t->until.
+ * The time left is measured on the wall clock, then added to the time
+ * already elapsed, so the percentage stays relative to the start.
+ * @param t a pointer to a ut_timer
+ */
+static void timer_update_until(ut_timer *t)
+{
+  gint64 now = ut_clock_source_now(ut_clock_source_get_realtime());
+  ut_duration left = MAX(t->until - now, 0);
+
+  t->length = duration_add(MAX(ut_timer_get_elapsed(t), 0), left);
+  g_debug("%s: %" G_GINT64_FORMAT " ns left on the wall clock", __FUNCTION__, left);
+
+  // wakes up at the end, or when the wall clock is set before that
+  deadline_source_set(t->until_source, left > 0 ? t->until : DEADLINE_NONE);
+
+  if (ut_timer_is_paused(t))
+    return;
+  if (t->wheel)
+    timer_arm_expiry(t);
+  if (t->print_source)
+    timer_arm_print(t);
+}
+
+static gboolean timer_until_changed(ut_timer *t)
+{
+  timer_update_until(t);
+  return TRUE;
+}
+
+static void timer_stop_until(ut_timer *t)
+{
+  if (!t->until_source)
+    return;
+
+  g_source_destroy(t->until_source);
+  g_source_unref(t->until_source);
+  t->until_source = NULL;
+}
+
+/** Makes the given countdown end at a time of the wall clock (--until).
+ * The length becomes the time left until then. When the wall clock is set
+ * (e.g. stepped by NTP), a CLOCK_REALTIME timerfd wakes us up once and the
+ * length is evaluated again, so the countdown still ends at that time; the
+ * wall clock is never polled. Pausing does not push the end further.
+ * @param t a pointer to a ut_timer, in countdown mode
+ * @param until CLOCK_REALTIME time in nanoseconds (see parse_until_pattern())
+ */
+void timer_set_until(ut_timer *t, gint64 until)
+{
+  g_assert(t && t->mode == TIMER_MODE_COUNTDOWN);
+
+  t->until = until;
+
+  if (!t->until_source)
+  {
+    t->until_source = deadline_source_new(ut_clock_source_get_realtime());
+    g_source_set_callback(t->until_source, (GSourceFunc) timer_until_changed, t, NULL);
+    g_source_attach(t->until_source, t->context->main_context);
+  }
+
+  timer_update_until(t);
+}
+
+/** Called from the timing wheel when the expiry deadline is reached.
+ * Time spent paused is not known when the deadline is armed, so the timer is
+ * checked once more and re-armed if it did not actually reach its length.
+ * Within the spin margin, the clock is polled until the exact end instead.
+ * @param table the table of the wheel of the ut_timer
+ * @param handle the expiry timer of the ut_timer, which it keeps as data
+ */
+static void timer_expired(ut_timer_table *table, ut_timer_handle handle, gpointer data)
+{
+  ut_timer *t = timer_table_get_data(table, handle);
+  ut_duration remaining;
+
+  timer_record_wakeup(t, timer_table_get_deadline(table, handle));
+  remaining = ut_timer_get_remaining(t);
+
+  // the clock was stopped after the deadline was armed: ut_timer_resume() arms it again
+  if (remaining > 0 && ut_timer_is_paused(t))
+  {
+    g_debug("%s: paused, waiting to be resumed", __FUNCTION__);
+    return;
+  }
+
+  if (remaining > t->spin)
+  {
+    g_debug("%s: woke up early, re-arming", __FUNCTION__);
+    timer_arm_expiry(t);
+    return;
+  }
+
+  if (remaining > 0)
+    ut_clock_spin_until(t->clock, t->length);
+
+  t->overshoot = ut_timer_get_elapsed(t) - t->length;
+  g_debug("%s: overshoot is %" G_GINT64_FORMAT " ns", __FUNCTION__, t->overshoot);
+
+  /* Time's up! stop updating the display, and call back */
+  timer_stop_print(t);
+  timer_stop_until(t);
+
+  wheel_remove_timer(t->wheel, t->expiry);
+  wheel_unref(t->wheel);
+  t->wheel = NULL;
+
+  g_debug("%s: timer expired", __FUNCTION__);
+  if (t->success_callback)
+    t->success_callback(t, t->user_data);
+}
+
+/** Starts waiting for the given ut_timer to expire.
+ * The expiry deadline goes into the timing wheel of the clock source, which
+ * all the timers of the context on that clock share (see
+ * wheel_ref_for_clock()), so many timers still make a single deadline source
+ * on the main context. It does
+ * not wake up before the timer length has elapsed, then calls the success
+ * callback from the main loop. Stopwatches never expire and are ignored.
+ * @param t a pointer to a ut_timer
+ */
+static void timer_start_expiry(ut_timer *t)
+{
+  g_assert(t);
+
+  if (t->mode == TIMER_MODE_STOPWATCH || t->wheel)
+    return;
+
+  t->wheel = wheel_ref_for_clock(t->context, t->clock->source);
+  t->expiry = wheel_add_timer(t->wheel, timer_expired, NULL, t);
+  if (t->expiry == TIMER_HANDLE_NONE)
+  {
+    g_debug("%s: too many timers on this clock", __FUNCTION__);
+    wheel_unref(t->wheel);
+    t->wheel = NULL;
+    if (t->error_callback)
+      t->error_callback(t, t->user_data);
+    return;
+  }
+
+  if (!ut_timer_is_paused(t))
+    timer_arm_expiry(t);
+}
+
+/** Starts the given ut_timer from 0: its clock is reset and started (see
+ * ut_clock_start()), then it waits to expire (see timer_start_expiry()).
+ * Starting it again restarts it. The other timers measuring their time with
+ * the same clock restart with it.
+ * @param t a pointer to a ut_timer
+ */
+void ut_timer_start(ut_timer *t)
+{
+  g_assert(t && t->clock);
+
+  ut_clock_start(t->clock);
+  t->overshoot = -1;
+
+  // a countdown to a time of the wall clock still ends at that time
+  if (t->until_source)
+    timer_update_until(t);
+
+  if (t->wheel)
+    timer_arm_expiry(t);
+  else
+    timer_start_expiry(t);
+
+  if (t->print_source)
+    timer_arm_print(t);
+}
+
+/** Sets how long before expiring the given ut_timer stops sleeping.
+ * The main loop sleeps until spin before the end, then the clock is polled
+ * in a busy loop until the end. This is far more accurate than waking up
+ * from a sleep, at the cost of burning a CPU during spin. 0 (the default)
+ * disables spinning.
+ * @param t a pointer to a ut_timer
+ * @param spin the spin margin
+ */
+void timer_set_spin(ut_timer *t, ut_duration spin)
+{
+  g_assert(t);
+
+  t->spin = MAX(spin, 0);
+  if (t->wheel && !ut_timer_is_paused(t))
+    timer_arm_expiry(t);
+}
+
+/** Starts measuring the given ut_timer (see timer_stats).
+ * Until this is called, the timer does not measure anything, so that the
+ * wake-ups only cost a pointer check.
+ * @param t a pointer to a ut_timer
+ */
+void timer_enable_stats(ut_timer *t)
+{
+  g_assert(t);
+
+  if (t->stats)
+    return;
+
+  t->stats = g_new0(timer_stats, 1);
+  stats_histogram_init(&t->stats->lateness);
+}
+
+/** Pauses the given ut_timer.
+ * The elapsed time stops increasing and the expiry and print sources are
+ * disarmed. A stream (see timer_start_stream()) gets a record right away.
+ * This must be called from the main loop thread.
+ * @param t a pointer to a ut_timer
+ */
+void ut_timer_pause(ut_timer *t)
+{
+  g_assert(t && t->clock);
+
+  ut_clock_stop(t->clock);
+  if (t->wheel)
+    wheel_disarm(t->wheel, t->expiry);
+  if (t->print_source)
+    deadline_source_set(t->print_source, DEADLINE_NONE);
+  if (t->stream_source)
+    timer_write_record(t);
+}
+
+/** Resumes the given ut_timer after ut_timer_pause().
+ * The expiry and print sources are re-armed, a stream gets a record.
+ * This must be called from the main loop thread.
+ * @param t a pointer to a ut_timer
+ */
+void ut_timer_resume(ut_timer *t)
+{
+  g_assert(t && t->clock);
+
+  ut_clock_continue(t->clock);
+  if (t->until_source)
+    timer_update_until(t);
+  if (t->wheel)
+    timer_arm_expiry(t);
+  if (t->print_source)
+    timer_arm_print(t);
+  if (t->stream_source)
+    timer_write_record(t);
+}
+
+/** Marks a lap of the given ut_timer: a stream (see timer_start_stream())
+ * gets a record now, and a printed line is kept on the terminal, the next
+ * frames being printed on a new line below it.
+ * @param t a pointer to a ut_timer
+ */
+void timer_lap(ut_timer *t)
+{
+  g_assert(t);
+
+  if (t->stream_source)
+  {
+    timer_write_record(t);
+    return;
+  }
+
+  if (!t->print_source || t->context->quiet)
+    return;
+
+  timer_print(t);
+  if (!stream_write(t->renderer->fd, "\n", 1))
+    g_debug("%s: writing to the terminal failed", __FUNCTION__);
+  progress_renderer_invalidate(t->renderer);
+}
+
 gchar* timer_get_maximum_time()
 {
   ut_timer *t = g_new(ut_timer, 1);
   gchar* ret;
-  t->seconds = G_MAXUINT;
-  t->mseconds = 999;
+  t->length = UT_DURATION_MAX;
   t->precision = TIMER_PRECISION_MILLISECOND;
 
   ret = timer_ut_timer_to_string(t);
@@ -264,16 +777,16 @@ gchar* timer_get_maximum_time()
   return ret;
 }
 
-gboolean parse_time_pattern(gchar *pattern, guint *seconds, guint *mseconds)
+gboolean ut_parse_time_pattern(gchar *pattern, ut_duration *duration)
 {
   gchar *endptr, *tmp;
-  guint val;
+  guint64 num;
+  ut_duration val;
 
-  if (!pattern || !seconds || !mseconds)
+  if (!pattern || !duration)
     return FALSE;
 
-  *seconds = 0;
-  *mseconds = 0;
+  *duration = 0;
 
   tmp = pattern;
 
@@ -283,245 +796,402 @@ gboolean parse_time_pattern(gchar *pattern, guint *seconds, guint *mseconds)
 
     errno = 0; /* To distinguish success/failure after call */
 
-    val = (guint) strtoul(tmp, &endptr, 10);
-    g_debug("strtoul() returned %u", val);
+    num = g_ascii_strtoull(tmp, &endptr, 10);
+    g_debug("g_ascii_strtoull() returned %" G_GUINT64_FORMAT, num);
 
     /* Check for various possible errors */
 
-    if (errno == ERANGE && val == G_MAXUINT)
+    if (errno == ERANGE || num > (guint64) UT_DURATION_MAX)
     {
       if (*endptr == '\0')
-        g_warning(_("The last number is too big. It has been changed into: %u"), val);
+        g_warning(_("The last number is too big. The longest possible time is used instead."));
       else
-        g_warning(_("The number before '%s' is too big. It has been changed into: %u"), endptr, val);
+        g_warning(_("The number before '%s' is too big. The longest possible time is used instead."), endptr);
+      num = UT_DURATION_MAX;
     }
 
-    // if parsing the milliseconds
+    val = (ut_duration) num;
+
+    // if parsing the milli, micro or nanoseconds
     if (endptr && g_str_has_prefix(endptr, "ms"))
     {
-      *mseconds = ui_add(*mseconds, val);
+      val = duration_mul(val, UT_NSEC_PER_MSEC);
       endptr = endptr + 2; // we go after the 'ms' part
     }
+    else if (endptr && g_str_has_prefix(endptr, "us"))
+    {
+      val = duration_mul(val, UT_NSEC_PER_USEC);
+      endptr = endptr + 2;
+    }
+    else if (endptr && g_str_has_prefix(endptr, "ns"))
+    {
+      endptr = endptr + 2;
+    }
     else if (endptr && apply_suffix(&val, endptr)) // if parsing another unit
     {
-      *seconds = ui_add(*seconds, val);
       if (*endptr != '\0')
         endptr = endptr + 1;
     }
     else
     {
-      g_error(_("Error when trying to parse: %s"), endptr);
+      g_warning(_("Error when trying to parse: %s"), endptr);
       return FALSE;
     }
 
+    *duration = duration_add(*duration, val);
     tmp = endptr;
   } while (*endptr != '\0');
 
   return TRUE;
 }
 
-void timer_add_seconds(ut_timer* timer, guint seconds)
+/** Reads the end time given to --until.
+ * pattern can be a time of day, HH:MM or HH:MM:SS (the next time the local
+ * clock shows it, so possibly tomorrow), an ISO 8601 date and time (e.g.
+ * 2010-06-01T18:30:00+02:00) or a number of seconds since the Epoch
+ * written @SECONDS (e.g. @1275409800.5).
+ * @param until where to store the CLOCK_REALTIME time, in nanoseconds
+ * @return FALSE if pattern cannot be read
+ */
+gboolean parse_until_pattern(const gchar *pattern, gint64 *until)
 {
-  g_debug("Adding %u seconds", seconds);
-  timer->seconds = ui_add(timer->seconds, seconds);
-  g_debug("timer.seconds = %u", timer->seconds);
-}
+  guint hour, min, sec = 0;
+  gint len = 0;
+  GTimeVal tv;
 
-void timer_add_milliseconds(ut_timer* timer, guint milliseconds)
-{
-  guint extra_seconds;
+  if (!pattern || !until)
+    return FALSE;
+
+  if (pattern[0] == '@')
+  {
+    const gchar *frac;
+    gchar *endptr;
+    gint64 ns = 0, unit = UT_NSEC_PER_SEC;
+
+    errno = 0;
+    *until = g_ascii_strtoll(pattern + 1, &endptr, 10);
+    if (errno || endptr == pattern + 1 || *until < 0
+        || *until > G_MAXINT64 / UT_NSEC_PER_SEC - 1)
+      return FALSE;
+
+    if (*endptr == '.')
+    {
+      for (frac = endptr + 1; g_ascii_isdigit(*frac); frac++)
+        if ((unit /= 10) > 0)
+          ns += (*frac - '0') * unit;
+      endptr = (gchar *) frac;
+    }
+
+    if (*endptr != '\0')
+      return FALSE;
+
+    *until = *until * UT_NSEC_PER_SEC + ns;
+    return TRUE;
+  }
+
+  if ((sscanf(pattern, "%2u:%2u%n", &hour, &min, &len) == 2 && pattern[len] == '\0')
+      || (sscanf(pattern, "%2u:%2u:%2u%n", &hour, &min, &sec, &len) == 3 && pattern[len] == '\0'))
+  {
+    gint64 now = ut_clock_source_now(ut_clock_source_get_realtime());
+    time_t today = (time_t) (now / UT_NSEC_PER_SEC), end;
+    struct tm tm;
+
+    if (hour > 23 || min > 59 || sec > 59 || !localtime_r(&today, &tm))
+      return FALSE;
+
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = sec;
+    tm.tm_isdst = -1;
+    end = mktime(&tm);
+
+    // already passed today: tomorrow then
+    if ((gint64) end * UT_NSEC_PER_SEC <= now)
+    {
+      tm.tm_mday++;
+      tm.tm_hour = hour;
+      tm.tm_min = min;
+      tm.tm_sec = sec;
+      tm.tm_isdst = -1;
+      end = mktime(&tm);
+    }
+
+    if (end == (time_t) -1)
+      return FALSE;
+
+    *until = (gint64) end * UT_NSEC_PER_SEC;
+    return TRUE;
+  }
 
-  extra_seconds = milliseconds / 1000;
-  if (extra_seconds > 0)
+  if (g_time_val_from_iso8601(pattern, &tv))
   {
-    timer_add_seconds(timer, extra_seconds);
-    milliseconds -= extra_seconds * 1000;
+    *until = (gint64) tv.tv_sec * UT_NSEC_PER_SEC + (gint64) tv.tv_usec * UT_NSEC_PER_USEC;
+    return TRUE;
   }
 
-  timer->mseconds = ui_add(timer->mseconds, milliseconds);
+  return FALSE;
+}
+
+/** Makes the given ut_timer longer. A running timer waits for its new
+ * length: the expiry and print sources are armed again, and the end of a
+ * countdown to a time of the wall clock (see timer_set_until()) moves too.
+ */
+void timer_add_time(ut_timer* timer, ut_duration duration)
+{
+  g_debug("Adding %" G_GINT64_FORMAT " ns", duration);
+  timer->length = duration_add(timer->length, duration);
+  g_debug("timer.length = %" G_GINT64_FORMAT, timer->length);
+
+  if (timer->until_source)
+    timer->until = duration_add(timer->until, duration);
+
+  if (ut_timer_is_paused(timer))
+    return;
+  if (timer->wheel)
+    timer_arm_expiry(timer);
+  if (timer->print_source)
+    timer_arm_print(timer);
 }
 
 /**
- * Return human readable string for the given time.
+ * Writes the human readable string for the given time into buf.
+ * Returns the length of the resulting string, like g_snprintf().
  */
-gchar* timer_sec_msec_to_string(guint sec, guint msec, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */)
+gint timer_format_duration(gchar *buf, gsize size, ut_duration duration, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */)
 {
-  g_assert(msec < 1000);
-  guint all_secs = sec;
-  guint all_min = sec / 60;
-  guint days = sec / 86400;
-  sec -= days * 86400;
+  g_assert(duration >= 0);
+  gint64 all_secs = duration / UT_NSEC_PER_SEC;
+  guint nsec = (guint) (duration % UT_NSEC_PER_SEC);
+  guint msec = nsec / 1000000;
+  guint all_min = (guint) (all_secs / 60);
+  guint days = (guint) (all_secs / 86400);
+  guint sec = (guint) (all_secs % 86400);
   guint hours = sec / 3600;
   sec -= hours * 3600;
   guint minutes = sec / 60;
   sec -= minutes * 60;
+  gchar all_secs_str[24];
+
+  // may not fit in a guint, formatted apart to keep the translated strings simple
+  g_snprintf(all_secs_str, sizeof(all_secs_str), "%" G_GINT64_FORMAT, all_secs);
 
   if (precision == TIMER_PRECISION_HOUR)
-    return g_strdup_printf(C_("DAYCOUNT days HOURS hours",
-                              "%u days %02u hours"),
-                           days,
-                           hours
-                           );
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS hours",
+                         "%u days %02u hours"),
+                      days,
+                      hours
+                      );
   else if (precision == TIMER_PRECISION_MINUTE)
-    return g_strdup_printf(C_("DAYCOUNT days HOURS:MINUTES (MINUTES minutes)",
-                              "%u days %02u:%02u (%02u minutes)"),
-                           days,
-                           hours,
-                           minutes,
-                           all_min
-                           );
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS:MINUTES (MINUTES minutes)",
+                         "%u days %02u:%02u (%02u minutes)"),
+                      days,
+                      hours,
+                      minutes,
+                      all_min
+                      );
   else if (precision == TIMER_PRECISION_SECOND)
-    return g_strdup_printf(C_("DAYCOUNT days HOURS:MINUTES:SECONDS (SECONDS seconds)",
-                              "%u days %02u:%02u:%02u (%u seconds)"),
-                           days,
-                           hours,
-                           minutes,
-                           sec,
-                           all_secs
-                           );
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS:MINUTES:SECONDS (SECONDS seconds)",
+                         "%u days %02u:%02u:%02u (%s seconds)"),
+                      days,
+                      hours,
+                      minutes,
+                      sec,
+                      all_secs_str
+                      );
+  else if (precision == TIMER_PRECISION_MICROSECOND)
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS:MINUTES:SECONDS:MICROSECONDS (SECONDS.MICROSECONDS seconds)",
+                         "%u days %02u:%02u:%02u.%06u (%s.%06u seconds)"),
+                      days,
+                      hours,
+                      minutes,
+                      sec,
+                      nsec / 1000,
+                      all_secs_str,
+                      nsec / 1000);
+  else if (precision == TIMER_PRECISION_NANOSECOND)
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS:MINUTES:SECONDS:NANOSECONDS (SECONDS.NANOSECONDS seconds)",
+                         "%u days %02u:%02u:%02u.%09u (%s.%09u seconds)"),
+                      days,
+                      hours,
+                      minutes,
+                      sec,
+                      nsec,
+                      all_secs_str,
+                      nsec);
   else
-    return g_strdup_printf(C_("DAYCOUNT days HOURS:MINUTES:SECONDS:MILLISECONDS (SECONDS.MILLISECONDS seconds)",
-                              "%u days %02u:%02u:%02u.%03u (%u.%03u seconds)"),
-                           days,
-                           hours,
-                           minutes,
-                           sec,
-                           msec,
-                           all_secs,
-                           msec);
-
+    return g_snprintf(buf, size,
+                      C_("DAYCOUNT days HOURS:MINUTES:SECONDS:MILLISECONDS (SECONDS.MILLISECONDS seconds)",
+                         "%u days %02u:%02u:%02u.%03u (%s.%03u seconds)"),
+                      days,
+                      hours,
+                      minutes,
+                      sec,
+                      msec,
+                      all_secs_str,
+                      msec);
 }
 
-gchar* timer_gtvaldiff_to_string(GTimeValDiff g, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */)
+/**
+ * Return human readable string for the given time.
+ */
+gchar* timer_duration_to_string(ut_duration duration, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */)
 {
-  return timer_sec_msec_to_string(g.tv_sec, g.tv_usec / 1000, precision);
+  gchar buf[TIMER_TEXT_MAX];
+
+  timer_format_duration(buf, sizeof(buf), duration, precision);
+  return g_strdup(buf);
 }
 
 gchar* timer_ut_timer_to_string(ut_timer *g)
 {
   if (G_UNLIKELY(!g))
     return NULL;
-  return timer_sec_msec_to_string(g->seconds, g->mseconds, g->precision);
+  return timer_duration_to_string(g->length, g->precision);
 }
 
-static ut_timer* timer_new(guint seconds,
-                           guint mseconds,
+static ut_timer* timer_new(ut_duration length,
                            timer_mode mode,
-                           GVoidFunc success_callback,
-                           GVoidFunc error_callback,
-                           GTimer* timer,
+                           timer_func success_callback,
+                           timer_func error_callback,
+                           gpointer user_data,
+                           ut_context* context,
+                           ut_clock* clock,
                            timer_precision precision /* = TIMER_PRECISION_DEFAULT */,
                            const timer_display* display /* = NULL */)
 {
-  if (!timer)
+  if (!context || !clock)
   {
-    g_debug("%s: timer is NULL. Returning NULL.", __FUNCTION__);
+    g_debug("%s: context or clock is NULL. Returning NULL.", __FUNCTION__);
     return NULL;
   }
 
   ut_timer* t;
   t = g_new(ut_timer, 1);
-  t->seconds = seconds;
-
-  // if we have mseconds > 1000, we have seconds to add to t->seconds
-  if (mseconds >= 1000)
-  {
-    t->seconds = ui_add(t->seconds, mseconds / 1000);
-    t->mseconds = mseconds % 1000;
-  }
-  else
-    t->mseconds = mseconds;
-
-  // our mseconds must be lower than 1000
-  g_assert_cmpuint(t->mseconds, <, 1000);
-
+  t->length = MAX(length, 0);
   t->mode = mode;
-  t->checkloop_thread_stop_with_error = FALSE;
+  t->print_source = NULL;
+  t->wheel = NULL;
+  t->expiry = TIMER_HANDLE_NONE;
+  t->spin = 0;
+  t->overshoot = -1;
+  t->stream_source = NULL;
+  t->format = STREAM_FORMAT_NONE;
+  t->stream_interval = 0;
+  t->stream_next = DEADLINE_NONE;
+  t->until_source = NULL;
+  t->until = DEADLINE_NONE;
+  t->frame = progress_frame_new();
+  t->renderer = progress_renderer_new(STDOUT_FILENO);
+  t->stats = NULL;
   t->success_callback = success_callback;
   t->error_callback = error_callback;
-  t->gtimer = timer;
+  t->user_data = user_data;
+  t->context = context;
+  t->clock = clock;
   timer_set_precision(t, precision);
   timer_set_display(t, display ? *display : timer_default_display);
 
   return t;
 }
 
-ut_timer* timer_new_timer(guint seconds,
-                          guint mseconds,
-                          GVoidFunc success_callback,
-                          GVoidFunc error_callback,
-                          GTimer* timer,
-                          timer_precision precision,
-                          const timer_display* display)
+/** Creates a timer, counting from 0 up to length.
+ * Nothing runs until ut_timer_start() is called.
+ * @param success_callback called from the main loop when the timer expires
+ * @param error_callback called if the timer cannot wait to expire (there are
+ *        already TIMER_TABLE_MAX_TIMERS on its clock source)
+ * @param user_data given to both callbacks
+ * @param context where the timer runs (see ut_context_new())
+ * @param clock what the timer measures its time with (not freed with it)
+ * @param display what timer_print() shows, NULL for the default
+ */
+ut_timer* ut_timer_new_timer(ut_duration length,
+                             timer_func success_callback,
+                             timer_func error_callback,
+                             gpointer user_data,
+                             ut_context* context,
+                             ut_clock* clock,
+                             timer_precision precision,
+                             const timer_display* display)
 {
-  return timer_new(seconds, mseconds, TIMER_MODE_TIMER, success_callback, error_callback, timer, precision, display);
+  return timer_new(length, TIMER_MODE_TIMER, success_callback, error_callback, user_data, context, clock, precision, display);
 }
 
-ut_timer* timer_new_countdown(guint seconds,
-                              guint mseconds,
-                              GVoidFunc success_callback,
-                              GVoidFunc error_callback,
-                              GTimer* timer,
-                              timer_precision precision,
-                              const timer_display* display)
+/** Creates a countdown, counting from length down to 0.
+ * See ut_timer_new_timer() for the parameters.
+ */
+ut_timer* ut_timer_new_countdown(ut_duration length,
+                                 timer_func success_callback,
+                                 timer_func error_callback,
+                                 gpointer user_data,
+                                 ut_context* context,
+                                 ut_clock* clock,
+                                 timer_precision precision,
+                                 const timer_display* display)
 {
-  return timer_new(seconds, mseconds, TIMER_MODE_COUNTDOWN, success_callback, error_callback, timer, precision, display);
+  return timer_new(length, TIMER_MODE_COUNTDOWN, success_callback, error_callback, user_data, context, clock, precision, display);
 }
 
-ut_timer* timer_new_stopwatch(GVoidFunc success_callback,
-                              GVoidFunc error_callback,
-                              GTimer* timer,
-                              timer_precision precision,
-                              const timer_display* display)
+/** Creates a stopwatch: it counts up and never expires.
+ * See ut_timer_new_timer() for the parameters.
+ */
+ut_timer* ut_timer_new_stopwatch(timer_func success_callback,
+                                 timer_func error_callback,
+                                 gpointer user_data,
+                                 ut_context* context,
+                                 ut_clock* clock,
+                                 timer_precision precision,
+                                 const timer_display* display)
 {
-  return timer_new(0, 0, TIMER_MODE_STOPWATCH, success_callback, error_callback, timer, precision, display);
+  return timer_new(0, TIMER_MODE_STOPWATCH, success_callback, error_callback, user_data, context, clock, precision, display);
 }
 
 /** Destroy the ut_timer and assigns NULL to t
  * This destroys the given ut_timer and assigns NULL to the pointer t.
  * @param t a pointer to a ut_timer
  */
-gboolean timer_destroy(ut_timer* t)
+gboolean ut_timer_destroy(ut_timer* t)
 {
   if (!t)
     return TRUE;
 
+  if (t->wheel)
+  {
+    wheel_remove_timer(t->wheel, t->expiry);
+    wheel_unref(t->wheel);
+  }
+
+  if (t->stream_source)
+  {
+    g_source_destroy(t->stream_source);
+    g_source_unref(t->stream_source);
+  }
+
+  timer_stop_print(t);
+  timer_stop_until(t);
+  progress_frame_free(t->frame);
+  progress_renderer_free(t->renderer);
+  g_free(t->stats);
   g_free(t);
   t = NULL;
 
   return TRUE;
 }
 
-gint8 timer_get_progress_percent(const ut_timer *t)
+/** Returns the percentage of the length of the given ut_timer that elapsed.
+ * The result is rounded, and is 100 when the timer has no length.
+ * @param t a pointer to a ut_timer
+ */
+gint8 ut_timer_get_progress_percent(const ut_timer *t)
 {
   if (!t)
     return -1;
 
-  GTimeValDiff elapsed = timer_get_diff(t);
-
-  gdouble perc = 0;
-
-  // if we can ignore the milliseconds
-  if (t->seconds >= TIMER_PERC_IGNORE_MSEC_THRESHOLD)
-  {
-    g_debug("%s: ignoring milliseconds", __FUNCTION__);
-    perc = 100 * elapsed.tv_sec / t->seconds;
-  }
-  else
-  {
-    g_debug("%s: taking milliseconds into account", __FUNCTION__);
-    g_assert_cmpuint(elapsed.tv_sec, <=, TIMER_PERC_IGNORE_MSEC_THRESHOLD);
-    g_assert_cmpuint(t->seconds, <=, TIMER_PERC_IGNORE_MSEC_THRESHOLD);
-
-    if (G_LIKELY(t->seconds > 0 || t->mseconds > 0))
-      perc = (gdouble) (elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000) * 100 / (gdouble) (t->seconds * 1000 + t->mseconds);
-    else
-      perc = 100;
-
-  }
-
-  g_debug("%s: calculated perc: %.2f", __FUNCTION__, perc);
-  return (gint8) round(perc);
+  return timer_percent_at(t, ut_timer_get_elapsed(t));
 }
 
 void inline timer_set_precision(ut_timer *t, timer_precision precision)
@@ -24,16 +24,19 @@
 #ifndef TIMER_H
   #define TIMER_H
 
+  #include "libutimer.h"
+  #include "context.h"
   #include "utils.h"
+  #include "progress.h"
+  #include "stream.h"
+  #include "clock.h"
+  #include "wheel.h"
+  #include "stats.h"
   #define round(x) ((x)>=0?(long)((x)+0.5):(long)((x)-0.5))
-  #define TIMER_PERC_IGNORE_MSEC_THRESHOLD 1000 // lower bound of when to ignore milliseconds (in seconds)
-
-typedef struct
-{
-  guint tv_sec;
-  guint tv_usec;
-  gboolean negative;
-} GTimeValDiff;
+  #define TIMER_TEXT_MAX 256 // size of the buffers holding the time text
+  #define TIMER_DEFAULT_COLS 80 // width used when the terminal size is unknown
+  #define TIMER_PRINT_MIN_INTERVAL_MSEC 89 // shortest time between two frames
+  #define TIMER_DEFAULT_SPIN_USEC 200 // default spin margin of --precise
 
 typedef enum
 {
@@ -43,67 +46,60 @@ typedef enum
   TIMER_MODE_TIMER
 } timer_mode;
 
-typedef enum
-{
-  TIMER_PRECISION_DEFAULT,
-  TIMER_PRECISION_MILLISECOND,
-  TIMER_PRECISION_SECOND,
-  TIMER_PRECISION_MINUTE,
-  TIMER_PRECISION_HOUR
-} timer_precision;
-
+/* What a ut_timer measures about itself (see timer_enable_stats()) */
 typedef struct
 {
-  gboolean perc: 1, text: 1, bar: 1;
-} timer_display;
-
+  stats_histogram lateness; // how late the sources woke up
+  guint64 wakeups;
+  guint64 frames; // frames printed and records streamed
+  guint64 bytes_written; // by the stream (the renderer counts its own)
+} timer_stats;
 
-
-typedef struct
+struct _ut_timer
 {
-  GTimer *gtimer;
-  guint seconds;
-  guint mseconds;
-  GVoidFunc success_callback;
-  GVoidFunc error_callback;
-  guint timer_print_source_id;
+  ut_context *context; // where the sources are attached (not freed with it)
+  ut_clock *clock;
+  ut_duration length;
+  timer_func success_callback;
+  timer_func error_callback;
+  gpointer user_data; // given to the callbacks
+  GSource *print_source;
+  ut_wheel *wheel; // holds the expiry timer until the timer expires
+  ut_timer_handle expiry; // in the table of wheel
+  ut_duration spin; // how long before expiring to stop sleeping and spin
+  ut_duration overshoot; // how late the timer expired, -1 until it does
+  progress_frame *frame;
+  progress_renderer *renderer;
+  timer_stats *stats;
+  GSource *stream_source;
+  stream_format format;
+  ut_duration stream_interval; // time between two records
+  gint64 stream_next; // when the next record is due (see ut_clock_source_now())
+  GSource *until_source;
+  gint64 until; // CLOCK_REALTIME end of the countdown (see timer_set_until())
   timer_mode mode;
-  gboolean checkloop_thread_stop_with_error;
   timer_precision precision;
   timer_display display;
-} ut_timer;
+};
 
+gboolean timer_build_frame(const ut_timer *t, progress_frame *frame, gushort cols);
 gboolean timer_print(ut_timer *t);
-gboolean timer_check_loop(ut_timer *t);
-gboolean timer_run_checkloop_thread(ut_timer *t);
-gboolean parse_time_pattern(gchar *pattern, guint *seconds, guint *mseconds);
-void timer_add_seconds(ut_timer* timer, guint seconds);
-void timer_add_milliseconds(ut_timer* timer, guint milliseconds);
-GTimeVal gtvaldiff_to_gtval(GTimeValDiff g);
-gchar* timer_sec_msec_to_string(guint sec, guint msec, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */);
+ut_duration timer_get_next_change(const ut_timer *t);
+void timer_start_print(ut_timer *t);
+void timer_stop_print(ut_timer *t);
+gsize timer_build_record(const ut_timer *t, gchar *buf, gsize size, stream_format format);
+void timer_start_stream(ut_timer *t, stream_format format, ut_duration interval);
+void timer_stop_stream(ut_timer *t);
+void timer_set_spin(ut_timer *t, ut_duration spin);
+void timer_enable_stats(ut_timer *t);
+void timer_set_until(ut_timer *t, gint64 until);
+gboolean parse_until_pattern(const gchar *pattern, gint64 *until);
+void timer_add_time(ut_timer* timer, ut_duration duration);
+void timer_lap(ut_timer *t);
+gint timer_format_duration(gchar *buf, gsize size, ut_duration duration, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */);
+gchar* timer_duration_to_string(ut_duration duration, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */);
 gchar* timer_get_maximum_time();
 gchar* timer_ut_timer_to_string(ut_timer *g);
-gchar* timer_gtvaldiff_to_string(GTimeValDiff g, timer_precision precision /* = TIMER_PRECISION_MILLISECOND */);
-ut_timer* timer_new_timer(guint seconds,
-                          guint mseconds,
-                          GVoidFunc success_callback,
-                          GVoidFunc error_callback,
-                          GTimer* timer,
-                          timer_precision precision,
-                          const timer_display* display);
-ut_timer* timer_new_countdown(guint seconds,
-                              guint mseconds,
-                              GVoidFunc success_callback,
-                              GVoidFunc error_callback,
-                              GTimer* timer,
-                              timer_precision precision,
-                              const timer_display* display);
-ut_timer* timer_new_stopwatch(GVoidFunc success_callback,
-                              GVoidFunc error_callback,
-                              GTimer* timer,
-                              timer_precision precision,
-                              const timer_display* display);
-gint8 timer_get_progress_percent(const ut_timer *t);
 void inline timer_set_precision (ut_timer *t, timer_precision precision);
 void inline timer_set_display (ut_timer *t, timer_display display);
 #endif /* TIMER_H */
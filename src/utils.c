@@ -60,33 +60,40 @@ gulong ul_mul(gulong a, gulong b) // only positive multiplication
     return a * b;
 }
 
-guint ui_add(guint a, guint b)
+ut_duration duration_add(ut_duration a, ut_duration b) // only positive durations
 {
-  if (a > G_MAXUINT - b)
+  g_assert(a >= 0 && b >= 0);
+
+  if (a > UT_DURATION_MAX - b)
   {
     g_debug("Overflowing addition...");
-    return G_MAXUINT;
+    return UT_DURATION_MAX;
   }
   else
     return a + b;
 }
 
-guint ui_mul(guint a, guint b) // only positive multiplication
+ut_duration duration_mul(ut_duration a, ut_duration b) // only positive multiplication
 {
   g_assert(a >= 0 && b >= 0);
 
-  if (a > G_MAXUINT / b)
+  if (b != 0 && a > UT_DURATION_MAX / b)
   {
     g_debug("Overflowing multiplication...");
-    return G_MAXUINT;
+    return UT_DURATION_MAX;
   }
   else
     return a * b;
 }
 
-gboolean apply_suffix(guint *value, gchar *suffix)
+/**
+ * Converts value, a count of the unit given by suffix, into nanoseconds.
+ * The suffix can be 'd', 'h', 'm', 's' or nothing (seconds).
+ * Returns FALSE if the suffix is unknown.
+ */
+gboolean apply_suffix(ut_duration *value, gchar *suffix)
 {
-  gint factor = 1;
+  ut_duration factor = UT_NSEC_PER_SEC;
 
   g_return_val_if_fail(value, FALSE);
 
@@ -95,49 +102,29 @@ gboolean apply_suffix(guint *value, gchar *suffix)
     {
       case 0:
       case 's':
-        factor = 1;
+        factor = UT_NSEC_PER_SEC;
         break;
       case 'm':
-        factor = 60;
+        factor = 60 * UT_NSEC_PER_SEC;
         break;
       case 'h':
-        factor = 60 * 60;
+        factor = 60 * 60 * UT_NSEC_PER_SEC;
         break;
       case 'd':
-        factor = 60 * 60 * 24;
+        factor = 60 * 60 * 24 * UT_NSEC_PER_SEC;
         break;
       default:
         return FALSE;
     }
 
-  g_debug("%s: applying factor %d to %u", __FUNCTION__, factor, *value);
-  (*value) = ui_mul(*value, factor);
+  g_debug("%s: applying factor %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT,
+          __FUNCTION__, factor, *value);
+  (*value) = duration_mul(*value, factor);
 
   return TRUE;
 }
 
 
-void init_config(Config *conf)
-{
-  conf->locale = NULL;
-  conf->verbose = FALSE;
-  conf->quiet = FALSE;
-  conf->debug = FALSE;
-  conf->quit_with_success = FALSE;
-  conf->current_exit_status_code = EXIT_SUCCESS;
-  conf->timer = g_timer_new();
-}
-
-void free_config(Config *conf)
-{
-  if (conf->timer)
-  {
-    g_debug("Freeing config timer...");
-    g_timer_destroy(conf->timer);
-    conf->timer = NULL;
-  }
-}
-
 /**
  * Returns the number of columns of the terminal or 0 if fails.
  */
@@ -169,11 +156,11 @@ gushort get_terminal_width()
 
 
 /**
- * Return  a progress bar of a given size and percentage (in a gchar).
- * This returns a pointer to gchar containing a progress bar of
- * a given size and percentage.
+ * Writes a progress bar of a given size and percentage into buf.
+ * buf must have room for width+1 characters (the bar and a '\0').
+ * Nothing is allocated, so this can be used on every refresh.
  */
-gchar* get_progress_bar(gint8 perc, gushort width, gboolean go_right)
+void fill_progress_bar(gchar *buf, gint8 perc, gushort width, gboolean go_right)
 {
   // [=====>    ]  if go_right
   // [    <=====]  if !go_right
@@ -185,21 +172,19 @@ gchar* get_progress_bar(gint8 perc, gushort width, gboolean go_right)
   gushort bar_length = (guint) real_width * (guint) perc / 100;
   gushort empty_length = real_width - bar_length;
 
-  gchar *ret = g_new(gchar, width+1);
-
   if(width == 0)
   {
-    ret[0] = '\0';
-    return ret;
+    buf[0] = '\0';
+    return;
   }
 
-  ret[0] = '[';
-  ret[width-1] = ']';
-  ret[width] = '\0';
+  buf[0] = '[';
+  buf[width-1] = ']';
+  buf[width] = '\0';
 
   gint start = 1;
   gint i = start;
-  gchar* c = &ret[i];
+  gchar* c = &buf[i];
   while(i < start+empty_length+bar_length)
   {
     if(go_right)
@@ -221,8 +206,20 @@ gchar* get_progress_bar(gint8 perc, gushort width, gboolean go_right)
         *c = '=';
     }
 
-    c = &ret[++i];
+    c = &buf[++i];
   }
+}
+
+/**
+ * Return  a progress bar of a given size and percentage (in a gchar).
+ * This returns a pointer to gchar containing a progress bar of
+ * a given size and percentage (see fill_progress_bar()).
+ */
+gchar* get_progress_bar(gint8 perc, gushort width, gboolean go_right)
+{
+  gchar *ret = g_new(gchar, width+1);
+
+  fill_progress_bar(ret, perc, width, go_right);
 
   //g_debug("my progress bar: %s", ret);
   return ret;
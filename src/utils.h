@@ -24,26 +24,15 @@
 #ifndef UTILS_H
   #define UTILS_H
 
-typedef struct
-{
-  gchar *locale;
-  gboolean verbose;
-  gboolean quiet;
-  gboolean debug;
-  gboolean quit_with_success;
-  gint current_exit_status_code;
-  GTimer *timer;
-  gushort terminal_cols;
-} Config;
+  #include "clock.h"
 
 gulong ul_mul(gulong a, gulong b);
 gulong ul_add(gulong a, gulong b);
-guint ui_add(guint a, guint b);
-guint ui_mul(guint a, guint b);
-gboolean apply_suffix(guint *value, gchar *suffix);
-void init_config(Config *conf);
-void free_config(Config *conf);
+ut_duration duration_add(ut_duration a, ut_duration b);
+ut_duration duration_mul(ut_duration a, ut_duration b);
+gboolean apply_suffix(ut_duration *value, gchar *suffix);
 gushort get_terminal_width();
+void fill_progress_bar(gchar *buf, gint8 perc, gushort width, gboolean go_right);
 gchar* get_progress_bar(gint8 perc, gushort width, gboolean go_right);
 
 
@@ -22,14 +22,29 @@
  */
 
 #include "utimer.h"
+#include "log.h"
 
-static gchar *timer_info, *countdown_info, *refresh_rate;
+/* The state of this run of the program. The timers, the batch, the log
+ * handler and the signal source are given a pointer to it, only atexit()
+ * reaches it from here. */
+static Config ut_config;
+static struct termios savedttystate;
+
+static gchar *timer_info, *countdown_info, *refresh_rate, *format, *format_rate,
+             *clock_name, *until_info, *batch_file;
 static gboolean stopwatch = FALSE,
         show_limits = FALSE,
         show_version = FALSE,
         show_bar = FALSE,
         show_perc = FALSE,
-        show_text = TRUE;
+        show_text = TRUE,
+        show_stats = FALSE;
+static ut_duration precise_spin = 0;
+
+static gboolean parse_precise_option(const gchar *option_name,
+                                     const gchar *value,
+                                     gpointer data,
+                                     GError **error);
 
 static GOptionEntry entries[] = {
 
@@ -41,6 +56,26 @@ static GOptionEntry entries[] = {
    N_("show a progress bar representing the remaining/elapsed time"),
    NULL},
 
+  {"batch",
+   0,
+   0,
+   G_OPTION_ARG_FILENAME,
+   &batch_file,
+   N_("run all the timers listed in FILE ('-' for the standard input) at\
+ once, one 'NAME countdown|timer TIMELENGTH' per line, and write a record\
+ as each one expires"),
+   N_("FILE")},
+
+  {"clock",
+   0,
+   0,
+   G_OPTION_ARG_STRING,
+   &clock_name,
+   N_("read the time from CLOCK: 'monotonic' (default), 'monotonic_raw'\
+ (not slewed by NTP), 'boottime' (counts time suspended) or 'tsc' (CPU time stamp\
+ counter, the fastest to read)"),
+   N_("CLOCK")},
+
   {"countdown",
    'c',
    0,
@@ -57,6 +92,23 @@ static GOptionEntry entries[] = {
    N_("debug output"),
    NULL},
 
+  {"format",
+   0,
+   0,
+   G_OPTION_ARG_STRING,
+   &format,
+   N_("write the progress as a stream of records instead of text. FORMAT\
+ can be 'jsonl', 'csv' or 'tsv'"),
+   N_("FORMAT")},
+
+  {"format-rate",
+   0,
+   0,
+   G_OPTION_ARG_STRING,
+   &format_rate,
+   N_("time between two records of --format (default: 1s)"),
+   N_("TIMELENGTH")},
+
   {"limits",
    'L',
    0,
@@ -73,6 +125,15 @@ static GOptionEntry entries[] = {
    N_("show a percentage representing the elapsed time"),
    NULL},
 
+  {"precise",
+   0,
+   G_OPTION_FLAG_OPTIONAL_ARG,
+   G_OPTION_ARG_CALLBACK,
+   parse_precise_option,
+   N_("spin (busy-wait) for the last SPIN_US microseconds to expire very\
+ accurately, then print how late it was (default: 200)"),
+   N_("SPIN_US")},
+
   {"quiet",
    'q',
    0,
@@ -95,9 +156,19 @@ static GOptionEntry entries[] = {
    G_OPTION_ARG_STRING,
    &(refresh_rate),
    N_("display refresh rate. RATE can be 'm' for minute, 's' for\
- second, 'ms' for millisecond (default)"),
+ second, 'ms' for millisecond (default), 'us' for microsecond, 'ns' for\
+ nanosecond"),
    N_("RATE")},
 
+  {"stats",
+   0,
+   0,
+   G_OPTION_ARG_NONE,
+   &show_stats,
+   N_("print how late the timer woke up, how much it printed and the CPU\
+ time used when exiting"),
+   NULL},
+
   {"stopwatch",
    's',
    0,
@@ -130,6 +201,15 @@ static GOptionEntry entries[] = {
    N_("count from 0 to TIMELENGTH then exit (e.g. -t 31m27s300ms)"),
    N_("TIMELENGTH")},
 
+  {"until",
+   0,
+   0,
+   G_OPTION_ARG_STRING,
+   &until_info,
+   N_("count down until TIME of the wall clock then exit. TIME can be\
+ HH:MM[:SS], an ISO 8601 date and time, or @SECONDS since the Epoch"),
+   N_("TIME")},
+
   {"verbose",
    'v',
    0,
@@ -149,8 +229,37 @@ static GOptionEntry entries[] = {
   {NULL}
 };
 
+/**
+ * Parses the optional SPIN_US value of --precise into precise_spin.
+ */
+static gboolean parse_precise_option(const gchar *option_name,
+                                     const gchar *value,
+                                     gpointer data,
+                                     GError **error)
+{
+  gchar *endptr;
+  guint64 usec = TIMER_DEFAULT_SPIN_USEC;
+
+  if (value)
+  {
+    usec = g_ascii_strtoull(value, &endptr, 10);
+    if (*value == '\0' || *endptr != '\0' || usec == 0
+        || usec > (guint64) UT_DURATION_MAX / UT_NSEC_PER_USEC)
+    {
+      g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                  _("Invalid spin time for %s: %s"), option_name, value);
+      return FALSE;
+    }
+  }
+
+  precise_spin = (ut_duration) usec * UT_NSEC_PER_USEC;
+  return TRUE;
+}
+
 /**
  * Activate/Deactivate the canonical mode from a TTY.
+ * Out of the canonical mode, each key is read as soon as it is hit, and
+ * is not echoed.
  */
 void set_tty_canonical(int state)
 {
@@ -160,7 +269,7 @@ void set_tty_canonical(int state)
   {
     g_debug("Activating canonical mode.");
     tcgetattr(STDIN_FILENO, &ttystate);
-    ttystate.c_lflag &= ~ICANON; // remove canonical mode
+    ttystate.c_lflag &= ~(ICANON | ECHO); // remove canonical mode and echo
     ttystate.c_cc[VMIN] = 1; // minimum length to read before sending
     tcsetattr(STDIN_FILENO, TCSANOW, &ttystate); // apply the changes
   }
@@ -180,25 +289,34 @@ void reset_tty_canonical_mode()
 }
 
 /**
- * Quits the main loop to end the program.
- * Quits the main loop to end the program with error_status
+ * Quits the main loop of conf to end the program with error_status
  * (EXIT_SUCCESS or EXIT_FAILURE).
  */
-void quitloop(int error_status)
+static void config_quitloop(Config *conf, int error_status)
 {
-  g_assert(loop);
+  g_assert(conf->loop);
   g_debug("%s: Stopping Main Loop (error code: %i)...", __FUNCTION__, error_status);
 
   // We set the exit status code
-  ut_config.current_exit_status_code = error_status;
-  g_main_loop_quit(loop);
+  conf->current_exit_status_code = error_status;
+  g_main_loop_quit(conf->loop);
+}
+
+/**
+ * Quits the main loop to end the program.
+ * Quits the main loop to end the program with error_status
+ * (EXIT_SUCCESS or EXIT_FAILURE).
+ */
+void quitloop(int error_status)
+{
+  config_quitloop(&ut_config, error_status);
 }
 
 /**
  * Quits the main loop with error to end the program.
  * Quits the main loop to end the program ungracefully (EXIT_FAILURE).
  * This function just calls quitloop(EXIT_FAILURE).
- * This is needed for signal traps.
+ * This is needed for idle callbacks.
  */
 void error_quitloop()
 {
@@ -206,64 +324,208 @@ void error_quitloop()
 }
 
 /**
- * Quits the main loop with success code to end the program.
- * Quits the main loop to end the program gracefully (EXIT_SUCCESS).
- * This function just calls quitloop(EXIT_SUCCESS).
- * This is needed for callbacks.
+ * Timer and batch callbacks, ending the program of the Config given as data
+ * when the timer is done.
+ */
+static void timer_succeeded(ut_timer *t, gpointer data)
+{
+  config_quitloop(data, EXIT_SUCCESS);
+}
+
+static void timer_failed(ut_timer *t, gpointer data)
+{
+  config_quitloop(data, EXIT_FAILURE);
+}
+
+static void batch_done(ut_batch *b, gpointer data)
+{
+  config_quitloop(data, EXIT_SUCCESS);
+}
+
+/**
+ * Acts on the signals received (see signal_source_new()), from the main loop:
+ * a resized terminal is measured again on the next frame, any other signal
+ * stops the main loop to exit correctly, but with error code.
  */
-void success_quitloop()
+static gboolean signal_received(gint signum, gpointer data)
 {
-  quitloop(EXIT_SUCCESS);
+  Config *conf = data;
+
+  if (signum == SIGWINCH)
+  {
+    g_debug("%s: Received SIGWINCH", __FUNCTION__);
+    ut_context_resized(conf->context);
+    return TRUE;
+  }
+
+  config_quitloop(conf, EXIT_FAILURE);
+  return TRUE;
 }
 
 /**
- * Updates terminal_cols and starts waiting for signal again.
+ * Pauses or resumes the given timer.
  */
-void terminal_size_changed(gint s)
+static void toggle_pause(ut_timer *t)
 {
-  ut_config.terminal_cols = get_terminal_width();
-  g_message("\r ");
-  g_debug("%s: Received SIGWINCH cols=%d",
-          __FUNCTION__, ut_config.terminal_cols);
+  if (ut_timer_is_paused(t))
+    ut_timer_resume(t);
+  else
+    ut_timer_pause(t);
 }
 
 /**
- * Check to see if the user wants to quit.
- * This function waits till the user hits the 'q' key to quit the program,
- * then it will call the quitloop function. This is called by a thread
- * to avoid blocking the program.
+ * Acts on the keys hit by the user (see watch_keys()):
+ * 'q' quits, the spacebar pauses or resumes the timer, ENTER marks a lap
+ * and '+' adds a minute to a timer or countdown. ENTER is '\r' from the
+ * terminal, '\n' from a pipe, and "\r\n" from CRLF input: a '\n' right
+ * after a '\r' is the same ENTER, so it does not mark a second lap.
+ * Returns FALSE to stop watching, at the end of the input.
  */
-int check_exit_from_user()
+static gboolean key_pressed(GIOChannel *channel, GIOCondition condition, key_watch *keys)
 {
-  set_tty_canonical(1); /* Apply canonical mode to TTY*/
-  g_atexit(reset_tty_canonical_mode); /* Deactivate canonical mode at exit */
+  gchar buf[64];
+  gssize n, i;
+
+  n = read(g_io_channel_unix_get_fd(channel), buf, sizeof(buf));
+  if (n < 0 && (errno == EINTR || errno == EAGAIN))
+    return TRUE;
+  if (n <= 0)
+  {
+    /* e.g. stdin is /dev/null in a script: nothing more to wait for */
+    g_debug("%s: end of input, not watching keys anymore", __FUNCTION__);
+    return FALSE;
+  }
 
-  gint c;
-  do
+  for (i = 0; i < n; i++)
   {
-    c = fgetc(stdin);
-    g_print("\b \b"); // backspace, write a space to clear, backspace again
-    switch (c)
+    switch (buf[i])
     {
-      case ' ':
-      {
-        if (paused)
-        {
-          g_timer_continue(ut_config.timer);
-          paused = FALSE;
-        }
-        else
-        {
-          g_timer_stop(ut_config.timer);
-          paused = TRUE;
-        }
-      }
+      case 'q':
+      case 'Q':
+        config_quitloop(keys->conf, keys->conf->quit_with_success ? EXIT_SUCCESS : EXIT_FAILURE);
+        return FALSE;
 
+      case ' ':
+        if (keys->timer)
+          toggle_pause(keys->timer);
+        break;
+
+      case '\n':
+        if (keys->after_cr)
+          break;
+        /* fall through */
+      case '\r':
+        if (keys->timer)
+          timer_lap(keys->timer);
+        break;
+
+      case '+':
+        if (keys->timer && keys->timer->mode != TIMER_MODE_STOPWATCH)
+          timer_add_time(keys->timer, KEY_EXTEND_LENGTH);
+        break;
     }
-  } while (c != 'q' && c != 'Q'); /* checks for 'q' key */
 
-  /* If the user asks for exiting, we stop the loop. */
-  quitloop((ut_config.quit_with_success ? EXIT_SUCCESS : EXIT_FAILURE));
+    keys->after_cr = (buf[i] == '\r');
+  }
+
+  return TRUE;
+}
+
+/**
+ * Watches the keys hit on stdin from the main loop of keys->conf.
+ * The terminal is taken out of the canonical mode until the program exits,
+ * so that keys are read (with read(), no stdio buffering) as soon as they
+ * are hit. Returns the source of the watch.
+ */
+static GSource* watch_keys(key_watch *keys)
+{
+  GIOChannel *channel = g_io_channel_unix_new(STDIN_FILENO);
+  GSource *source = g_io_create_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR);
+
+  g_source_set_callback(source, (GSourceFunc) key_pressed, keys, NULL);
+  g_source_attach(source, ut_context_get_main_context(keys->conf->context));
+  g_io_channel_unref(channel);
+
+  if (isatty(STDIN_FILENO))
+  {
+    set_tty_canonical(1); /* Apply canonical mode to TTY*/
+    g_atexit(reset_tty_canonical_mode); /* Deactivate canonical mode at exit */
+  }
+
+  return source;
+}
+
+/**
+ * Prints the stats measured by the given timer (see --stats) on stderr,
+ * along with the CPU time used by the process.
+ */
+static void print_stats(ut_timer *t)
+{
+  const stats_histogram *h;
+  struct rusage usage;
+
+  if (!t || !t->stats)
+    return;
+
+  h = &t->stats->lateness;
+  g_printerr(_("Wake-up lateness: p50 %.3f us, p90 %.3f us, p99 %.3f us,\
+ max %.3f us\n"),
+             (gdouble) stats_histogram_percentile(h, 50) / UT_NSEC_PER_USEC,
+             (gdouble) stats_histogram_percentile(h, 90) / UT_NSEC_PER_USEC,
+             (gdouble) stats_histogram_percentile(h, 99) / UT_NSEC_PER_USEC,
+             (gdouble) h->max / UT_NSEC_PER_USEC);
+  g_printerr(_("Wake-ups: %lu, frames: %lu, bytes written: %lu\n"),
+             (gulong) t->stats->wakeups,
+             (gulong) t->stats->frames,
+             (gulong) (t->renderer->bytes_written + t->stats->bytes_written));
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    g_printerr(_("CPU time: %ld.%06ld s user, %ld.%06ld s system\n"),
+               (glong) usage.ru_utime.tv_sec, (glong) usage.ru_utime.tv_usec,
+               (glong) usage.ru_stime.tv_sec, (glong) usage.ru_stime.tv_usec);
+}
+
+static void init_config(Config *conf)
+{
+  conf->locale = NULL;
+  conf->verbose = FALSE;
+  conf->quiet = FALSE;
+  conf->debug = FALSE;
+  conf->log_to_stderr = FALSE;
+  conf->quit_with_success = FALSE;
+  conf->current_exit_status_code = EXIT_SUCCESS;
+  conf->context = ut_context_new(NULL);
+  conf->loop = NULL;
+  conf->clock = ut_clock_new();
+  conf->clock_source = NULL;
+}
+
+static void free_config(Config *conf)
+{
+  if (conf->clock)
+  {
+    g_debug("Freeing config clock...");
+    ut_clock_destroy(conf->clock);
+    conf->clock = NULL;
+  }
+
+  if (conf->loop)
+  {
+    g_main_loop_unref(conf->loop);
+    conf->loop = NULL;
+  }
+
+  if (conf->context)
+  {
+    ut_context_free(conf->context);
+    conf->context = NULL;
+  }
+
+  if (conf->clock_source)
+  {
+    ut_clock_source_free(conf->clock_source);
+    conf->clock_source = NULL;
+  }
 }
 
 static void clean_up(void)
@@ -290,6 +552,41 @@ static void clean_up(void)
     g_free(refresh_rate);
     refresh_rate = NULL;
   }
+
+  if (format)
+  {
+    g_debug("Freeing format...");
+    g_free(format);
+    format = NULL;
+  }
+
+  if (format_rate)
+  {
+    g_debug("Freeing format_rate...");
+    g_free(format_rate);
+    format_rate = NULL;
+  }
+
+  if (until_info)
+  {
+    g_debug("Freeing until_info...");
+    g_free(until_info);
+    until_info = NULL;
+  }
+
+  if (batch_file)
+  {
+    g_debug("Freeing batch_file...");
+    g_free(batch_file);
+    batch_file = NULL;
+  }
+
+  if (clock_name)
+  {
+    g_debug("Freeing clock_name...");
+    g_free(clock_name);
+    clock_name = NULL;
+  }
 }
 
 int main(int argc, char *argv[])
@@ -297,13 +594,20 @@ int main(int argc, char *argv[])
   GError *error = NULL;
   GOptionContext *context;
   gchar *tmp = NULL;
-  ut_timer *ttimer;
-  gint print_refresh_rate;
+  ut_timer *ttimer = NULL;
+  ut_batch *batch = NULL;
+  key_watch keys;
+  GSource *keys_source;
+  GSource *signals_source;
+  const gint handled_signals[] = { SIGWINCH, SIGALRM, SIGHUP, SIGINT,
+                                   SIGPIPE, SIGQUIT, SIGTERM };
+  stream_format stream = STREAM_FORMAT_NONE;
+  ut_duration stream_interval = UT_NSEC_PER_SEC;
+  gint64 until = 0;
   /* -------------- Initialization ------------- */
 
   tcgetattr(STDIN_FILENO, &savedttystate); /* Save current tty state  */
 
-  g_thread_init(NULL);
   g_type_init();
   init_config(&ut_config);
 
@@ -330,23 +634,14 @@ int main(int argc, char *argv[])
   textdomain(GETTEXT_PACKAGE);
 
   /* Set up the log handler */
-  setup_log_handler();
-
-  /* Handles any change of size for the terminal */
-  (void) signal(SIGWINCH, terminal_size_changed);
-  /* force the signal to get the current terminal size */
-  terminal_size_changed(0);
+  setup_log_handler(&ut_config);
 
-  /* Set the function to call in case of receiving signals:
-   * we need to stop the main loop to exit correctly, but
-   * with error code!
-   */
-  (void) signal(SIGALRM, error_quitloop);
-  (void) signal(SIGHUP, error_quitloop);
-  (void) signal(SIGINT, error_quitloop);
-  (void) signal(SIGPIPE, error_quitloop);
-  (void) signal(SIGQUIT, error_quitloop);
-  (void) signal(SIGTERM, error_quitloop);
+  /* Receive the signals from the main loop rather than in handlers, before
+   * any thread is started: a change of size for the terminal, or a request
+   * to stop the main loop */
+  signals_source = signal_source_new(handled_signals, G_N_ELEMENTS(handled_signals));
+  g_source_set_callback(signals_source, (GSourceFunc) signal_received, &ut_config, NULL);
+  g_source_attach(signals_source, ut_context_get_main_context(ut_config.context));
 
 
 
@@ -388,9 +683,11 @@ int main(int argc, char *argv[])
         || show_version
         || show_limits
         || countdown_info
+        || until_info
+        || batch_file
         || stopwatch))
   {
-    g_printerr(_("No main option (-t, -c or -s) has been specified!\n"));
+    g_printerr(_("No main option (-t, -c, -s, --until or --batch) has been specified!\n"));
     g_printerr(_("Run '%s --help' to see a full list of available command\
  line options.\n"), argv[0]);
     exit(EXIT_FAILURE);
@@ -401,31 +698,111 @@ int main(int argc, char *argv[])
 
   if (ut_config.debug)
     ut_config.quiet = FALSE;
+  ut_context_set_quiet(ut_config.context, ut_config.quiet);
 
-  if (timer_info && (countdown_info || stopwatch)
-      || countdown_info && stopwatch)
+  if ((timer_info != NULL) + (countdown_info != NULL) + (until_info != NULL)
+      + (batch_file != NULL) + (stopwatch ? 1 : 0) > 1)
   {
     g_warning(_("Conflicting options!\nThe following options cannot\n\
  be used simultaneously:\n -t (timer mode), -c (countdown mode), -s\
- (stopwatch mode)."));
+ (stopwatch mode), --until (countdown to a time), --batch (many timers)."));
     exit(EXIT_FAILURE);
   }
 
-  /* set up refresh rate if given */
-  print_refresh_rate = 89;
-  if (refresh_rate)
+  if (until_info)
+  {
+    if (!parse_until_pattern(until_info, &until))
+    {
+      g_printerr(_("Cannot read the time '%s' (expected HH:MM[:SS], an ISO 8601\
+ date and time, or @SECONDS).\n"), until_info);
+      exit(EXIT_FAILURE);
+    }
+
+    if (until <= ut_clock_source_now(ut_clock_source_get_realtime()))
+    {
+      g_printerr(_("The time '%s' has already passed.\n"), until_info);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (format && !stream_format_from_string(format, &stream))
+  {
+    g_printerr(_("Unknown format '%s' (expected 'jsonl', 'csv' or 'tsv').\n"), format);
+    exit(EXIT_FAILURE);
+  }
+
+  if (format_rate)
+  {
+    if (!ut_parse_time_pattern(format_rate, &stream_interval))
+      exit(EXIT_FAILURE);
+    if (stream_interval <= 0)
+    {
+      g_printerr(_("The rate of --format cannot be 0.\n"));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (clock_name)
+  {
+    ut_clock_source_type clock_type;
+
+    if (!ut_clock_source_type_from_string(clock_name, &clock_type)
+        || clock_type == UT_CLOCK_SOURCE_VIRTUAL
+        || clock_type == UT_CLOCK_SOURCE_REALTIME)
+    {
+      g_printerr(_("Unknown clock '%s' (expected 'monotonic', 'monotonic_raw',\
+ 'boottime' or 'tsc').\n"), clock_name);
+      exit(EXIT_FAILURE);
+    }
+
+    ut_config.clock_source = ut_clock_source_new(clock_type);
+    if (ut_config.clock_source->type != clock_type && !ut_config.quiet)
+      g_printerr(_("The '%s' clock is not available, using '%s' instead.\n"),
+                 clock_name, ut_clock_source_type_to_string(ut_config.clock_source->type));
+
+    ut_clock_destroy(ut_config.clock);
+    ut_config.clock = ut_clock_new_with_source(ut_config.clock_source);
+  }
+
+  /* nothing is streamed in quiet mode */
+  if (ut_config.quiet)
+    stream = STREAM_FORMAT_NONE;
+
+  /* the records own stdout (a batch always writes some, unless quiet): the
+   * messages go to stderr, not in between */
+  if (stream != STREAM_FORMAT_NONE || batch_file)
+    ut_config.log_to_stderr = TRUE;
+
+  /* every timer of the batch is read before any starts. Their records are
+   * written as TSV unless --format says otherwise */
+  if (batch_file)
   {
-    if (g_ascii_strcasecmp(refresh_rate, "m") == 0)
+    gboolean from_stdin = (g_strcmp0(batch_file, "-") == 0);
+    FILE *in = (from_stdin ? stdin : fopen(batch_file, "r"));
+    gboolean ok;
+
+    if (!in)
     {
-      print_refresh_rate = 60 * 1000;
+      g_printerr(_("Cannot open '%s': %s.\n"), batch_file, g_strerror(errno));
+      exit(EXIT_FAILURE);
     }
-    else if (g_ascii_strcasecmp(refresh_rate, "s") == 0)
+
+    batch = batch_new(ut_config.context, ut_config.clock->source,
+                      ut_config.quiet ? STREAM_FORMAT_NONE : (format ? stream : STREAM_FORMAT_TSV),
+                      STDOUT_FILENO, batch_done, &ut_config);
+    ok = batch_read(batch, in, from_stdin ? _("(standard input)") : batch_file);
+    if (!from_stdin)
+      fclose(in);
+
+    if (!ok)
+      exit(EXIT_FAILURE);
+    if (batch->jobs->len == 0)
     {
-      print_refresh_rate = 1000;
+      g_printerr(_("There is no timer in '%s'.\n"), batch_file);
+      exit(EXIT_FAILURE);
     }
   }
 
-  g_debug("G_MAXUINT = %u", G_MAXUINT);
 
   if (isatty(STDOUT_FILENO))
     g_debug("\033[34mYou are using a TTY.\033[m");
@@ -471,10 +848,16 @@ int main(int argc, char *argv[])
 
   /* Prepare for starting the main loop */
 
-  loop = g_main_loop_new(NULL, FALSE);
+  ut_config.loop = g_main_loop_new(ut_context_get_main_context(ut_config.context), FALSE);
 
+  /* -------------- BATCH MODE -------------- */
+  if (batch)
+  {
+    g_debug("Batch Mode: %u timers", batch->jobs->len);
+    batch_start(batch);
+  }
   /* -------------- TIMER & COUNTDOWN MODE -------------- */
-  if (timer_info || countdown_info || stopwatch)
+  else if (timer_info || countdown_info || until_info || stopwatch)
   {
     g_debug("Setting up default precision");
     timer_precision precision = TIMER_PRECISION_MILLISECOND;
@@ -497,27 +880,42 @@ int main(int argc, char *argv[])
       {
         precision = TIMER_PRECISION_SECOND;
       }
+      else if (g_ascii_strcasecmp(refresh_rate, "us") == 0)
+      {
+        precision = TIMER_PRECISION_MICROSECOND;
+      }
+      else if (g_ascii_strcasecmp(refresh_rate, "ns") == 0)
+      {
+        precision = TIMER_PRECISION_NANOSECOND;
+      }
     }
 
-    guint seconds = 0;
-    guint mseconds = 0;
+    ut_duration length = 0;
 
     if (countdown_info)
     {
       g_debug("Countdown Mode");
-      parse_time_pattern(countdown_info, &(seconds), &(mseconds));
-      ttimer = timer_new_countdown(seconds, mseconds, success_quitloop, error_quitloop, ut_config.timer, precision, &options_timer_display);
+      if (!ut_parse_time_pattern(countdown_info, &length))
+        exit(EXIT_FAILURE);
+      ttimer = ut_timer_new_countdown(length, timer_succeeded, timer_failed, &ut_config, ut_config.context, ut_config.clock, precision, &options_timer_display);
+    }
+    else if (until_info)
+    {
+      g_debug("Countdown Mode, until a time of the wall clock");
+      ttimer = ut_timer_new_countdown(0, timer_succeeded, timer_failed, &ut_config, ut_config.context, ut_config.clock, precision, &options_timer_display);
+      timer_set_until(ttimer, until);
     }
     else if (timer_info)
     {
       g_debug("Timer Mode");
-      parse_time_pattern(timer_info, &(seconds), &(mseconds));
-      ttimer = timer_new_timer(seconds, mseconds, success_quitloop, error_quitloop, ut_config.timer, precision, &options_timer_display);
+      if (!ut_parse_time_pattern(timer_info, &length))
+        exit(EXIT_FAILURE);
+      ttimer = ut_timer_new_timer(length, timer_succeeded, timer_failed, &ut_config, ut_config.context, ut_config.clock, precision, &options_timer_display);
     }
     else
     {
       g_debug("Stopwatch Mode");
-      ttimer = timer_new_stopwatch(success_quitloop, error_quitloop, ut_config.timer, precision, &options_timer_display);
+      ttimer = ut_timer_new_stopwatch(timer_succeeded, timer_failed, &ut_config, ut_config.context, ut_config.clock, precision, &options_timer_display);
     }
 
     tmp = timer_get_maximum_time();
@@ -533,24 +931,22 @@ int main(int argc, char *argv[])
       tmp = NULL;
     }
 
-    // print timer once because the timeout loop waits before executing the func
-    timer_print(ttimer);
-    // create the timeout loop to print the timer every refresh_rate
-    ttimer->timer_print_source_id = g_timeout_add(print_refresh_rate,
-                                                  (GSourceFunc) timer_print,
-                                                  ttimer);
-    if (ttimer->mode != TIMER_MODE_STOPWATCH)
-    {
-      g_debug("Starting Timer thread");
-
-      if (!g_thread_create((GThreadFunc) timer_check_loop, ttimer, FALSE, &error))
-      {
-        g_printerr(_("Thread creation failed: %s"), error->message);
-        g_error_free(error);
-        error_quitloop();
-        exit(EXIT_FAILURE);
-      }
-    }
+    if (show_stats)
+      timer_enable_stats(ttimer);
+
+    /* print the timer now, then every time the displayed text changes.
+     * With --format, records are written at a fixed rate instead.
+     * Headless (quiet, or not a TTY): nothing is displayed while running,
+     * so there is no print source at all, only the expiry wakes us up. */
+    if (stream != STREAM_FORMAT_NONE)
+      timer_start_stream(ttimer, stream, stream_interval);
+    else if (ut_config.quiet || !isatty(STDOUT_FILENO))
+      g_debug("Headless mode: the timer is only printed when exiting");
+    else
+      timer_start_print(ttimer);
+    g_debug("Starting Timer expiry");
+    timer_set_spin(ttimer, precise_spin);
+    ut_timer_start(ttimer);
   } /* -------------- END TIMER & COUNTDOWN MODE -------------- */
   else
   {
@@ -558,26 +954,30 @@ int main(int argc, char *argv[])
     g_idle_add((GSourceFunc) error_quitloop, NULL);
   }
 
-  g_debug("Creating thread exit check");
-  if (!g_thread_create((GThreadFunc) check_exit_from_user, NULL, FALSE, &error))
-  {
-    // thread creation failed!
-    g_printerr(_("Thread creation failed: %s"), error->message);
-    g_error_free(error);
-    exit(EXIT_FAILURE);
-  }
+  g_debug("Watching the keys");
+  keys.conf = &ut_config;
+  keys.timer = ttimer;
+  keys.after_cr = FALSE;
+  keys_source = watch_keys(&keys);
 
   /* ------------- MAIN LOOP ---------------- */
 
   g_debug("Starting main loop...");
-  g_main_loop_run(loop);
-  g_main_loop_unref(loop);
-  loop = NULL;
+  g_main_loop_run(ut_config.loop);
+  g_source_destroy(keys_source);
+  g_source_unref(keys_source);
+  g_source_destroy(signals_source);
+  g_source_unref(signals_source);
   g_debug("Exiting main loop...");
 
   /* Print the timer one more time to show the actual time (in case of slow
-   * refresh rates. */
-  timer_print(ttimer);
+   * refresh rates. A stream ends with a record of the final state instead. */
+  if (batch)
+    g_debug("%u of the %u timers of the batch expired", batch->done, batch->jobs->len);
+  else if (stream != STREAM_FORMAT_NONE)
+    timer_stop_stream(ttimer);
+  else
+    timer_print(ttimer);
 
 
   /* ------------- END OF MAIN LOOP ---------------- */
@@ -586,8 +986,16 @@ int main(int argc, char *argv[])
 
 
   /* ================== CLEAN UP ==================== */
-  g_message("\n"); // print a new line if not in quiet mode
-  timer_destroy(ttimer);
+  if (stream == STREAM_FORMAT_NONE && !batch)
+    g_message("\n"); // print a new line if not in quiet mode
+
+  /* on stderr, so that it does not mix with the output of --format */
+  if (precise_spin > 0 && ttimer && ttimer->overshoot >= 0 && !ut_config.quiet)
+    g_printerr(_("Expired %.3f us late.\n"), (gdouble) ttimer->overshoot / UT_NSEC_PER_USEC);
+
+  print_stats(ttimer);
+  ut_timer_destroy(ttimer);
+  batch_free(batch);
 
   /* ================== MAIN DONE ==================== */
   return ut_config.current_exit_status_code;
@@ -28,17 +28,20 @@
 #  include <config.h>
 #endif
 
+#include <errno.h>
 #include <signal.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
 #include "utils.h"
 #include "timer.h"
-#include "log.h"
+#include "batch.h"
+#include "signals.h"
 
 #define SHORTDESCRIPTION _("command-line \"timer\" which features a timer,\
  a countdown and a stopwatch")
@@ -63,11 +66,30 @@
 
 #define DESCRIPTION ""
 
-#define TIMER_CHECK_RATE_MSEC  500
+#define KEY_EXTEND_LENGTH (60 * UT_NSEC_PER_SEC) // added to the timer by '+'
 
-GMainLoop         *loop;
-gboolean          paused;
-struct termios    savedttystate;
-Config            ut_config;
+/* The state of one run of the program (see init_config()) */
+typedef struct
+{
+  gchar *locale;
+  gboolean verbose;
+  gboolean quiet;
+  gboolean debug;
+  gboolean log_to_stderr; // stdout carries records (see --format, --batch)
+  gboolean quit_with_success;
+  gint current_exit_status_code;
+  ut_context *context; // where the timers run
+  GMainLoop *loop; // runs the main context of context
+  ut_clock *clock;
+  ut_clock_source *clock_source; // NULL for the default (CLOCK_MONOTONIC)
+} Config;
+
+/* What the keys hit by the user act on (see watch_keys()) */
+typedef struct
+{
+  Config *conf;
+  ut_timer *timer; // NULL when there is no timer (e.g. --batch)
+  gboolean after_cr; // the last key read was '\r' (see key_pressed())
+} key_watch;
 
 #endif /* UTIMER_H */
@@ -0,0 +1,451 @@
+/*
+ *  wheel.c
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "wheel.h"
+#include "deadline.h"
+
+#define WHEEL_PENDING 0xffff // bucket of the timers of the slot being run
+
+static inline guint wheel_lowest_bit(guint64 bits)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(bits);
+#else
+  guint i = 0;
+
+  while (!(bits & 1))
+  {
+    bits >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static inline guint wheel_highest_bit(guint64 bits)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(bits);
+#else
+  guint i = 0;
+
+  while (bits >>= 1)
+    i++;
+  return i;
+#endif
+}
+
+static inline gint64 wheel_tick_of(gint64 deadline)
+{
+  return MAX(deadline, 0) >> WHEEL_TICK_BITS;
+}
+
+/* Returns what points to the first timer of the given bucket: a slot of
+ * the wheel (level * WHEEL_SLOTS + slot), or the slot being run. */
+static inline guint32* wheel_head(ut_wheel *w, guint bucket)
+{
+  if (bucket == WHEEL_PENDING)
+    return &w->pending;
+  return &w->slots[bucket >> WHEEL_LEVEL_BITS][bucket & (WHEEL_SLOTS - 1)];
+}
+
+static void wheel_link(ut_wheel *w, guint index, guint bucket)
+{
+  ut_timer_table *t = w->timers;
+  guint32 *head = wheel_head(w, bucket);
+
+  t->next[index] = *head;
+  t->prev[index] = 0;
+  if (*head)
+    t->prev[*head - 1] = index + 1;
+  t->buckets[index] = bucket;
+  *head = index + 1;
+}
+
+static void wheel_unlink(ut_wheel *w, guint index)
+{
+  ut_timer_table *t = w->timers;
+  guint bucket = t->buckets[index];
+  guint32 *head = wheel_head(w, bucket);
+
+  if (t->prev[index])
+    t->next[t->prev[index] - 1] = t->next[index];
+  else
+    *head = t->next[index];
+  if (t->next[index])
+    t->prev[t->next[index] - 1] = t->prev[index];
+
+  if (bucket != WHEEL_PENDING && !*head)
+    w->occupied[bucket >> WHEEL_LEVEL_BITS] &= ~(G_GUINT64_CONSTANT(1) << (bucket & (WHEEL_SLOTS - 1)));
+}
+
+/* Puts the timer in the given slot of the table in its wheel slot. Its
+ * level is the highest group of WHEEL_LEVEL_BITS bits where its tick
+ * differs from the current tick: it moves down a level each time the
+ * current tick reaches that slot (see wheel_cascade()). */
+static void wheel_place(ut_wheel *w, guint index)
+{
+  gint64 tick = MAX(wheel_tick_of(w->timers->deadlines[index]), w->tick);
+  guint64 diff = (guint64) (tick ^ w->tick);
+  guint level = 0, slot;
+
+  if (diff >= WHEEL_SLOTS)
+    level = wheel_highest_bit(diff) / WHEEL_LEVEL_BITS;
+
+  slot = (tick >> (level * WHEEL_LEVEL_BITS)) & (WHEEL_SLOTS - 1);
+  wheel_link(w, index, level * WHEEL_SLOTS + slot);
+  w->occupied[level] |= G_GUINT64_CONSTANT(1) << slot;
+}
+
+/* Moves down the timers of the slots the current tick just reached, from
+ * the highest level, so that each one ends up in the first level. */
+static void wheel_cascade(ut_wheel *w)
+{
+  guint level, top = 0;
+
+  for (level = 1; level < WHEEL_LEVELS; level++)
+  {
+    if (w->tick & ((G_GINT64_CONSTANT(1) << (level * WHEEL_LEVEL_BITS)) - 1))
+      break;
+    top = level;
+  }
+
+  for (level = top; level > 0; level--)
+  {
+    guint slot = (w->tick >> (level * WHEEL_LEVEL_BITS)) & (WHEEL_SLOTS - 1);
+    guint32 first;
+
+    while ((first = w->slots[level][slot]))
+    {
+      wheel_unlink(w, first - 1);
+      wheel_place(w, first - 1);
+    }
+  }
+}
+
+/* Returns the next tick at which there is something to do: expiring the
+ * timers of a first level slot, or moving down those of a higher level
+ * slot (then level is set to that level). */
+static gint64 wheel_next_tick(const ut_wheel *w, guint *level)
+{
+  for (*level = 0; *level < WHEEL_LEVELS; (*level)++)
+  {
+    guint shift = *level * WHEEL_LEVEL_BITS;
+    guint index = (w->tick >> shift) & (WHEEL_SLOTS - 1);
+    guint64 bits = w->occupied[*level] & (~G_GUINT64_CONSTANT(0) << index);
+
+    if (bits)
+    {
+      gint64 base = (w->tick >> (shift + WHEEL_LEVEL_BITS)) << (shift + WHEEL_LEVEL_BITS);
+      return base | ((gint64) wheel_lowest_bit(bits) << shift);
+    }
+  }
+
+  return DEADLINE_NONE;
+}
+
+/* Arms the deadline source of the wheel at its next deadline. */
+static void wheel_arm_source(ut_wheel *w)
+{
+  if (!w->source)
+    return;
+
+  w->armed_at = wheel_next_deadline(w);
+  deadline_source_set(w->source, w->armed_at);
+}
+
+static gboolean wheel_dispatch(ut_wheel *w)
+{
+  // the callbacks may drop the last reference to the wheel
+  w->refcount++;
+
+  // the deadline source is disarmed while dispatching
+  w->armed_at = DEADLINE_NONE;
+  wheel_run(w, ut_clock_source_now(w->clock));
+  wheel_arm_source(w);
+
+  wheel_unref(w);
+  return TRUE;
+}
+
+/**
+ * Creates a new, empty, timing wheel.
+ * With a clock source, a deadline source is attached to main_context (NULL
+ * for the default one) to run the wheel on time. Without one (clock is
+ * NULL), nothing runs the wheel but wheel_run(), and the current time starts
+ * at 0.
+ */
+ut_wheel* wheel_new(ut_clock_source *clock, GMainContext *main_context)
+{
+  ut_wheel *w = g_new0(ut_wheel, 1);
+
+  w->clock = clock;
+  w->armed_at = DEADLINE_NONE;
+  w->refcount = 1;
+  w->timers = timer_table_new(0);
+
+  if (clock)
+  {
+    w->tick = wheel_tick_of(ut_clock_source_now(clock));
+    w->source = deadline_source_new(clock);
+    g_source_set_callback(w->source, (GSourceFunc) wheel_dispatch, w, NULL);
+    g_source_set_priority(w->source, G_PRIORITY_HIGH);
+    g_source_attach(w->source, main_context);
+  }
+
+  return w;
+}
+
+/**
+ * Frees the given wheel, with the timers still in it.
+ */
+void wheel_free(ut_wheel *w)
+{
+  if (!w)
+    return;
+
+  timer_table_free(w->timers);
+
+  if (w->source)
+  {
+    g_source_destroy(w->source);
+    g_source_unref(w->source);
+  }
+
+  g_free(w);
+}
+
+/**
+ * Returns the wheel shared by all the users of the given clock source in
+ * the given context, creating it if needed. Release it with wheel_unref().
+ * Each context has its own wheels, so a clock source used from several
+ * threads is only ever read.
+ */
+ut_wheel* wheel_ref_for_clock(ut_context *ctx, ut_clock_source *clock)
+{
+  ut_wheel *w;
+  GSList *l;
+
+  g_assert(ctx && clock);
+
+  for (l = ctx->wheels; l; l = l->next)
+  {
+    w = l->data;
+    if (w->clock == clock)
+    {
+      w->refcount++;
+      return w;
+    }
+  }
+
+  w = wheel_new(clock, ctx->main_context);
+  w->context = ctx;
+  ctx->wheels = g_slist_prepend(ctx->wheels, w);
+  return w;
+}
+
+void wheel_unref(ut_wheel *w)
+{
+  g_assert(w && w->refcount > 0);
+
+  if (--w->refcount > 0)
+    return;
+
+  if (w->context)
+    w->context->wheels = g_slist_remove(w->context->wheels, w);
+
+  wheel_free(w);
+}
+
+/**
+ * Adds a disarmed timer to the given wheel.
+ * @param func called with func_data when the timer expires, from wheel_run()
+ * @param data kept with the timer (see timer_table_get_data())
+ * @return its handle in the table of the wheel, or TIMER_HANDLE_NONE if full
+ */
+ut_timer_handle wheel_add_timer(ut_wheel *w, timer_table_func func, gpointer func_data, gpointer data)
+{
+  g_assert(w && func);
+
+  return timer_table_add(w->timers, timer_table_add_callback(w->timers, func, func_data), data);
+}
+
+/**
+ * Disarms a timer of the given wheel, and removes it from its table: the
+ * handle is stale from then on.
+ */
+void wheel_remove_timer(ut_wheel *w, ut_timer_handle handle)
+{
+  g_assert(w);
+
+  wheel_disarm(w, handle);
+  timer_table_remove(w->timers, handle);
+}
+
+/**
+ * Arms a timer of the given wheel to expire at deadline (a time of the
+ * clock source of the wheel, in nanoseconds). A timer that is already armed
+ * is moved. When the deadline is reached, the callback of the timer is
+ * called with the timer disarmed, so it may arm it again.
+ */
+void wheel_arm(ut_wheel *w, ut_timer_handle handle, gint64 deadline)
+{
+  ut_timer_table *t = w->timers;
+  guint index = timer_handle_index(handle);
+  gint64 previous = DEADLINE_NONE;
+
+  g_return_if_fail(timer_table_is_valid(t, handle));
+
+  if (t->states[index] & TIMER_STATE_ARMED)
+  {
+    previous = t->deadlines[index];
+    wheel_unlink(w, index);
+    w->count--;
+  }
+
+  t->deadlines[index] = deadline;
+  t->states[index] |= TIMER_STATE_ARMED;
+  wheel_place(w, index);
+  w->count++;
+
+  if (!w->source)
+    return;
+
+  // moving the timer the source was armed for may make it later
+  if (previous != DEADLINE_NONE && previous == w->armed_at)
+    wheel_arm_source(w);
+  else if (w->armed_at == DEADLINE_NONE || deadline < w->armed_at)
+  {
+    w->armed_at = deadline;
+    deadline_source_set(w->source, deadline);
+  }
+}
+
+/**
+ * Disarms a timer of the given wheel (if it is armed).
+ */
+void wheel_disarm(ut_wheel *w, ut_timer_handle handle)
+{
+  ut_timer_table *t = w->timers;
+  guint index = timer_handle_index(handle);
+
+  if (!timer_table_is_armed(t, handle))
+    return;
+
+  wheel_unlink(w, index);
+  t->states[index] &= ~TIMER_STATE_ARMED;
+  w->count--;
+
+  // the source was armed for this timer: it would wake up for nothing
+  if (t->deadlines[index] == w->armed_at)
+    wheel_arm_source(w);
+}
+
+/**
+ * Returns the earliest deadline of the given wheel, or DEADLINE_NONE if it
+ * is empty. It is in the first occupied slot, whatever its level: the
+ * timers of a higher level slot only move down once it is reached, by the
+ * run that expires the earliest of them (see wheel_run()), so a far
+ * deadline costs no wakeup before it.
+ */
+gint64 wheel_next_deadline(const ut_wheel *w)
+{
+  const ut_timer_table *t = w->timers;
+  gint64 tick, next = G_MAXINT64;
+  guint32 i;
+  guint level;
+
+  tick = wheel_next_tick(w, &level);
+  if (tick == DEADLINE_NONE)
+    return DEADLINE_NONE;
+
+  tick >>= level * WHEEL_LEVEL_BITS;
+  for (i = w->slots[level][tick & (WHEEL_SLOTS - 1)]; i; i = t->next[i - 1])
+    next = MIN(next, t->deadlines[i - 1]);
+
+  return next;
+}
+
+/**
+ * Expires the timers of the given wheel whose deadline is now or earlier,
+ * in the order of their ticks. Empty slots are skipped, so the cost does
+ * not depend on how long it has been since the last run.
+ * @return the number of timers that expired
+ */
+guint wheel_run(ut_wheel *w, gint64 now)
+{
+  ut_timer_table *t = w->timers;
+  gint64 tick, target = wheel_tick_of(now);
+  guint level, slot, fired = 0;
+  guint32 i;
+
+  while ((tick = wheel_next_tick(w, &level)) != DEADLINE_NONE && tick <= target)
+  {
+    if (tick != w->tick || level > 0)
+    {
+      w->tick = tick;
+      wheel_cascade(w);
+      if (level > 0)
+        continue;
+    }
+
+    // take the whole slot: the callbacks may add, arm or remove timers
+    slot = tick & (WHEEL_SLOTS - 1);
+    w->pending = w->slots[0][slot];
+    w->slots[0][slot] = 0;
+    w->occupied[0] &= ~(G_GUINT64_CONSTANT(1) << slot);
+    for (i = w->pending; i; i = t->next[i - 1])
+      t->buckets[i - 1] = WHEEL_PENDING;
+
+    // the arrays of the table may move if a callback adds timers
+    while ((i = w->pending))
+    {
+      guint index = i - 1;
+
+      wheel_unlink(w, index);
+      if (t->deadlines[index] <= now)
+      {
+        timer_table_callback callback = t->funcs[t->callbacks[index]];
+
+        t->states[index] &= ~TIMER_STATE_ARMED;
+        w->count--;
+        fired++;
+        callback.func(t, timer_table_handle(t, index), callback.data);
+      }
+      else
+        wheel_place(w, index); // later in the current tick
+    }
+
+    if (tick == target)
+      break;
+  }
+
+  w->tick = MAX(w->tick, target);
+  return fired;
+}
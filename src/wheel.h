@@ -0,0 +1,73 @@
+/*
+ *  wheel.h
+ *
+ *  Copyright 2010  Arnaud Soyez <weboide@codealpha.net>
+ *
+ *  This file is part of uTimer.
+ *  (uTimer is a CLI program that features a timer, countdown, and a stopwatch)
+ *
+ *  uTimer is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  uTimer is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with uTimer.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef WHEEL_H
+  #define WHEEL_H
+
+  #include <glib.h>
+  #include "clock.h"
+  #include "context.h"
+  #include "table.h"
+
+  #define WHEEL_TICK_BITS  20 // one tick is 2^20 ns (about 1 ms)
+  #define WHEEL_LEVEL_BITS 6
+  #define WHEEL_SLOTS      (1 << WHEEL_LEVEL_BITS)
+  #define WHEEL_LEVELS     8 // 20 + 8 * 6 bits: any positive gint64 deadline fits
+
+/* A hierarchical timing wheel: deadlines are hashed into WHEEL_LEVELS levels
+ * of WHEEL_SLOTS slots, the first level one tick per slot, the next one
+ * WHEEL_SLOTS ticks per slot, and so on. Adding and removing a timer is
+ * O(1), and a timer only moves down a level (at most WHEEL_LEVELS times)
+ * before it expires. Expiry is exact to the nanosecond, the ticks only sort
+ * the timers. The timers live in the table of the wheel, which holds their
+ * deadlines: a slot only keeps the first of its timers, the others are
+ * linked through the table. When the wheel has a clock source, a single
+ * deadline source is armed at its earliest timer and runs the wheel from
+ * the main loop. */
+typedef struct _ut_wheel
+{
+  ut_clock_source *clock;
+  ut_context *context; // that shares the wheel (see wheel_ref_for_clock())
+  GSource *source;
+  gint64 armed_at; // deadline of the source, DEADLINE_NONE if disarmed
+  gint refcount;
+  gint64 tick; // current tick, the earlier ones have all been run
+  guint count; // timers armed
+  ut_timer_table *timers; // armed or not
+  guint32 pending; // first timer (slot + 1) of the wheel slot being run
+  guint64 occupied[WHEEL_LEVELS]; // one bit per non-empty slot
+  guint32 slots[WHEEL_LEVELS][WHEEL_SLOTS]; // first timer (slot + 1), 0 if empty
+} ut_wheel;
+
+ut_wheel* wheel_new(ut_clock_source *clock, GMainContext *main_context);
+void wheel_free(ut_wheel *w);
+ut_wheel* wheel_ref_for_clock(ut_context *ctx, ut_clock_source *clock);
+void wheel_unref(ut_wheel *w);
+ut_timer_handle wheel_add_timer(ut_wheel *w, timer_table_func func, gpointer func_data, gpointer data);
+void wheel_remove_timer(ut_wheel *w, ut_timer_handle handle);
+void wheel_arm(ut_wheel *w, ut_timer_handle handle, gint64 deadline);
+void wheel_disarm(ut_wheel *w, ut_timer_handle handle);
+gint64 wheel_next_deadline(const ut_wheel *w);
+guint wheel_run(ut_wheel *w, gint64 now);
+
+#endif /* WHEEL_H */